@@ -1,9 +1,21 @@
 #include <iostream>
 #include <stack>
 #include <string>
+#include <string_view>
 #include <tuple>
+#include <vector>
+#include <array>
+#include <span>
+#include <chrono>
+#include <cstdint>
 #include <cctype>
+#include <cmath>
+#include <charconv>
+#include <algorithm>
 #include <stdexcept>
+#include <experimental/simd>
+
+namespace stdx = std::experimental;  // Alias for convenience
 
 auto get(std::stack<double> &values, std::stack<char> &ops) -> std::tuple<double, double, char>
 {
@@ -21,20 +33,21 @@ int precedence(char op)
 }
 
 // Function to perform arithmetic operations
-double applyOperator(double a, double b, char op)
+// trace: print every intermediate result
+double applyOperator(double a, double b, char op, bool trace = false)
 {
     switch (op)
     {
     case '+':
-        std::cout<< a << " + " << b << " = " << a + b<<"\n";
+        if (trace) std::cout<< a << " + " << b << " = " << a + b<<"\n";
         return a + b;
     case '-':
-        std::cout<< a << " - " << b << " = " << a - b<<"\n";
+        if (trace) std::cout<< a << " - " << b << " = " << a - b<<"\n";
         return a - b;
     case '*':
     {
         auto result = a * 1.0 * b;
-        std::cout<< a << " * " << b << " = " << result<< "\n";
+        if (trace) std::cout<< a << " * " << b << " = " << result<< "\n";
         return result;
     }
     case '/':
@@ -42,7 +55,7 @@ double applyOperator(double a, double b, char op)
         if (b == 0)
             throw std::invalid_argument("Division by zero");
         auto result = a * 1.0 / b;
-        std::cout<< a << " / " << b << " = " << result<<"\n";
+        if (trace) std::cout<< a << " / " << b << " = " << result<<"\n";
         return result;
     }
     default:
@@ -50,79 +63,1207 @@ double applyOperator(double a, double b, char op)
     }
 }
 
-// Function to evaluate infix expression
-double evaluateInfix(const std::string &infix)
+// Zero-copy tokenizer: tokens are views into the input, numbers are parsed in
+// place with std::from_chars (integers, decimals and exponents: 42, .5, 1.5e-3).
+// A '-' where an operand is expected is reported as Negate, and an identifier
+// directly followed by '(' is a Function call (min, max, abs, sqrt).
+enum class TokenKind : uint8_t
 {
-    std::stack<double> values; // Stack to store operands (numbers)
-    std::stack<char> ops;   // Stack to store operators
+    Number,
+    Identifier,
+    Function,
+    Operator,   // binary + - * /
+    Negate,     // unary minus
+    LeftParen,
+    RightParen,
+    Comma,
+    End,
+};
 
-    std::string number; // To accumulate multi-digit numbers
+struct Token
+{
+    TokenKind        kind;
+    char             op{};      // Operator
+    double           number{};  // Number
+    std::string_view text{};    // Identifier / Function name, or the raw token
+};
+
+class Tokenizer
+{
+public:
+    explicit Tokenizer(std::string_view input) : m_input(input) {}
 
-    for (char ch : infix)
+    Token next()
     {
-        if (isdigit(ch))
+        while (m_pos < m_input.size() && m_input[m_pos] == ' ') ++m_pos; // space is ok
+
+        if (m_pos == m_input.size())
+            return {TokenKind::End};
+
+        auto begin = m_pos;
+        char ch = m_input[m_pos];
+
+        if (isdigit(static_cast<unsigned char>(ch)) || ch == '.')
         {
-            number += ch; // Accumulate digits to form the full number
-            continue;
+            double number;
+            auto [end, ec] = std::from_chars(m_input.data() + m_pos, m_input.data() + m_input.size(), number);
+            if (ec != std::errc())
+                throw std::invalid_argument("Invalid number");
+            m_pos = end - m_input.data();
+            m_expectOperand = false;
+            return {TokenKind::Number, 0, number, m_input.substr(begin, m_pos - begin)};
         }
 
-        if (!number.empty())
+        if (isalpha(static_cast<unsigned char>(ch)) || ch == '_')
         {
-            values.push(std::stod(number)); // Push the number to the operand stack
-            number.clear();
+            while (m_pos < m_input.size() && (isalnum(static_cast<unsigned char>(m_input[m_pos])) || m_input[m_pos] == '_')) ++m_pos;
+            auto name = m_input.substr(begin, m_pos - begin);
+
+            auto after = m_pos;
+            while (after < m_input.size() && m_input[after] == ' ') ++after;
+            bool call = after < m_input.size() && m_input[after] == '(';
+
+            m_expectOperand = call;
+            return {call ? TokenKind::Function : TokenKind::Identifier, 0, 0, name};
         }
 
-        switch (ch) {
-        case '(': 
-            ops.push(ch); // Push left parenthesis to the operator stack
+        ++m_pos;
+        auto text = m_input.substr(begin, 1);
+        switch (ch)
+        {
+        case '(':
+            m_expectOperand = true;
+            return {TokenKind::LeftParen, ch, 0, text};
+        case ')':
+            m_expectOperand = false;
+            return {TokenKind::RightParen, ch, 0, text};
+        case ',':
+            m_expectOperand = true;
+            return {TokenKind::Comma, ch, 0, text};
+        case '-':
+            if (m_expectOperand)
+                return {TokenKind::Negate, ch, 0, text};
+            [[fallthrough]];
+        case '+':
+        case '*':
+        case '/':
+            m_expectOperand = true;
+            return {TokenKind::Operator, ch, 0, text};
+        default:
+            std::cerr << "'Unknown input " << ch << "'" << std::endl;
+            throw std::invalid_argument("Unknown input");
+        }
+    }
+
+private:
+    std::string_view m_input;
+    size_t m_pos{0};
+    bool m_expectOperand{true}; // tells unary from binary minus
+};
+
+// Function to evaluate infix expression
+double evaluateInfix(const std::string &infix, bool trace = false)
+{
+    std::stack<double> values; // Stack to store operands (numbers)
+    std::stack<char> ops;   // Stack to store operators
+
+    Tokenizer tokenizer(infix);
+    for (auto token = tokenizer.next(); token.kind != TokenKind::End; token = tokenizer.next())
+    {
+        switch (token.kind) {
+        case TokenKind::Number:
+            values.push(token.number); // Push the number to the operand stack
             break;
 
-        case ')':
+        case TokenKind::LeftParen:
+            ops.push('('); // Push left parenthesis to the operator stack
+            break;
+
+        case TokenKind::RightParen:
             while (!ops.empty() && ops.top() != '(') {
                 auto [a, b, op] = get(values, ops);
-                values.push(applyOperator(a, b, op)); // Apply the operator
+                values.push(applyOperator(a, b, op, trace)); // Apply the operator
             }
             ops.pop(); // Pop the left parenthesis
             break;
 
-        case '+':
-        case '-':
-        case '*':
-        case '/':
-            while (!ops.empty() && precedence(ops.top()) >= precedence(ch)) {
+        case TokenKind::Operator:
+            while (!ops.empty() && precedence(ops.top()) >= precedence(token.op)) {
                 auto [a, b, op] = get(values, ops);
-                values.push(applyOperator(a, b, op)); // Apply the operator
+                values.push(applyOperator(a, b, op, trace)); // Apply the operator
             }
-            ops.push(ch); // Push the current operator to the stack
-            break;
-
-        case ' ':
-            // space is ok
+            ops.push(token.op); // Push the current operator to the stack
             break;
 
         default:
-            std::cerr << "'Unknown input " << ch << "'" << std::endl;
+            // variables, functions and unary minus need CompiledExpression
+            std::cerr << "'Unknown input " << token.text << "'" << std::endl;
             throw std::invalid_argument("Unknown input");
-    }
-    }
-
-    if (!number.empty()) // input "100"
-    {
-        values.push(std::stod(number));
+        }
     }
 
     // Perform remaining operations
     while (!ops.empty())
     {
         auto [a, b, op] = get(values, ops);
-        values.push(applyOperator(a, b, op)); // Apply the operator
+        values.push(applyOperator(a, b, op, trace)); // Apply the operator
     }
 
     // The result is the last remaining value in the stack
     return values.top();
 }
 
-int main()
+// Compile once, evaluate many times.
+// The infix string is parsed a single time into postfix bytecode: operators whose
+// operands are all constants are folded, identifiers become variable slots.
+// Evaluation then walks the code over a fixed-size value stack, no allocation
+// and no I/O unless tracing is asked for.
+enum class OpCode : uint8_t
+{
+    Constant,   // push constants[index]
+    Variable,   // push variables[index]
+    // binary
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Min,
+    Max,
+    // unary
+    Neg,
+    Abs,
+    Sqrt,
+};
+
+struct Instruction
+{
+    OpCode   op;
+    uint32_t index; // operand of Constant/Variable, unused otherwise
+};
+
+constexpr bool isUnary(OpCode op)
+{
+    return op == OpCode::Neg || op == OpCode::Abs || op == OpCode::Sqrt;
+}
+
+std::string_view symbol(OpCode op)
+{
+    switch (op)
+    {
+    case OpCode::Add:  return "+";
+    case OpCode::Sub:  return "-";
+    case OpCode::Mul:  return "*";
+    case OpCode::Div:  return "/";
+    case OpCode::Min:  return "min";
+    case OpCode::Max:  return "max";
+    case OpCode::Neg:  return "-";
+    case OpCode::Abs:  return "abs";
+    case OpCode::Sqrt: return "sqrt";
+    default:           return "?";
+    }
+}
+
+OpCode toOpCode(char op)
+{
+    switch (op)
+    {
+    case '+': return OpCode::Add;
+    case '-': return OpCode::Sub;
+    case '*': return OpCode::Mul;
+    case '/': return OpCode::Div;
+    default:  throw std::invalid_argument("Unknown operator");
+    }
+}
+
+// function name -> opcode and argument count
+std::pair<OpCode, size_t> toFunction(std::string_view name)
+{
+    if (name == "min")  return {OpCode::Min, 2};
+    if (name == "max")  return {OpCode::Max, 2};
+    if (name == "abs")  return {OpCode::Abs, 1};
+    if (name == "sqrt") return {OpCode::Sqrt, 1};
+    throw std::invalid_argument("Unknown function");
+}
+
+// Generic over double and simd types, shared by the scalar and the batch evaluator
+template <OpCode Op, typename T>
+T applyBinary(T a, T b)
+{
+    constexpr bool scalar = std::is_same_v<T, double>;
+    if constexpr (Op == OpCode::Add) return a + b;
+    if constexpr (Op == OpCode::Sub) return a - b;
+    if constexpr (Op == OpCode::Mul) return a * b;
+    if constexpr (Op == OpCode::Div) return a / b;
+    if constexpr (Op == OpCode::Min) { if constexpr (scalar) return std::min(a, b); else return stdx::min(a, b); }
+    if constexpr (Op == OpCode::Max) { if constexpr (scalar) return std::max(a, b); else return stdx::max(a, b); }
+}
+
+template <OpCode Op, typename T>
+T applyUnary(T a)
+{
+    constexpr bool scalar = std::is_same_v<T, double>;
+    if constexpr (Op == OpCode::Neg) return -a;
+    if constexpr (Op == OpCode::Abs) { if constexpr (scalar) return std::abs(a); else return stdx::abs(a); }
+    if constexpr (Op == OpCode::Sqrt) { if constexpr (scalar) return std::sqrt(a); else return stdx::sqrt(a); }
+}
+
+// runtime opcode, for constant folding
+double applyOpCode(OpCode op, double a, double b = 0)
+{
+    switch (op)
+    {
+    case OpCode::Add:  return applyBinary<OpCode::Add>(a, b);
+    case OpCode::Sub:  return applyBinary<OpCode::Sub>(a, b);
+    case OpCode::Mul:  return applyBinary<OpCode::Mul>(a, b);
+    case OpCode::Div:
+        if (b == 0)
+            throw std::invalid_argument("Division by zero");
+        return applyBinary<OpCode::Div>(a, b);
+    case OpCode::Min:  return applyBinary<OpCode::Min>(a, b);
+    case OpCode::Max:  return applyBinary<OpCode::Max>(a, b);
+    case OpCode::Neg:  return applyUnary<OpCode::Neg>(a);
+    case OpCode::Abs:  return applyUnary<OpCode::Abs>(a);
+    case OpCode::Sqrt: return applyUnary<OpCode::Sqrt>(a);
+    default:           throw std::invalid_argument("Unknown operator");
+    }
+}
+
+class CompiledExpression
+{
+public:
+    // deepest value stack an expression may need, checked by compile()
+    static constexpr size_t MaxStack = 64;
+
+    static CompiledExpression compile(std::string_view infix);
+
+    // variables: one value per name, in the order of variables()
+    double evaluate(std::span<const double> variables, bool trace = false) const
+    {
+        if (variables.size() < m_variables.size())
+            throw std::invalid_argument("Missing variable values");
+
+        return trace ? run<true>(variables) : run<false>(variables);
+    }
+
+    // Batch evaluation over columns (SoA): columns[i] holds the values of
+    // variables()[i], one per row, and out receives one result per row.
+    // Rows are processed in blocks, each instruction runs as a SIMD loop over
+    // the whole block instead of the bytecode being interpreted per row.
+    void evaluateBatch(std::span<const std::span<const double>> columns, std::span<double> out) const;
+
+    // position of a variable in the span given to evaluate()
+    size_t variableIndex(std::string_view name) const
+    {
+        for (size_t i = 0; i < m_variables.size(); ++i)
+        {
+            if (m_variables[i] == name) return i;
+        }
+        throw std::invalid_argument("Unknown variable");
+    }
+
+    const std::vector<std::string>& variables() const { return m_variables; }
+    const std::vector<Instruction>& code() const { return m_code; }
+    const std::vector<double>& constants() const { return m_constants; }
+
+private:
+    using simd_t = stdx::native_simd<double>;
+
+    // rows per block, a multiple of every native SIMD width
+    static constexpr size_t BatchBlock = 256;
+
+    // value stack entry of the batch evaluator: a block of rows or a broadcast constant
+    struct Operand
+    {
+        const double* column; // nullptr for a constant
+        double constant;
+    };
+
+    CompiledExpression() = default;
+
+    static simd_t load(const double* column, size_t i)
+    {
+        return simd_t(column + i, stdx::element_aligned);
+    }
+
+    // Op is a template argument so the switch in applyBinary/applyUnary folds
+    // away and the loop body is a single vector instruction
+    template <OpCode Op>
+    static void blockLoop(const Operand& a, const Operand& b, double* dst, size_t rows)
+    {
+        constexpr auto width = simd_t::size();
+        size_t i = 0;
+        if (a.column && b.column)
+        {
+            for (; i + width <= rows; i += width)
+                applyBinary<Op>(load(a.column, i), load(b.column, i)).copy_to(dst + i, stdx::element_aligned);
+        }
+        else if (a.column)
+        {
+            simd_t vb(b.constant);
+            for (; i + width <= rows; i += width)
+                applyBinary<Op>(load(a.column, i), vb).copy_to(dst + i, stdx::element_aligned);
+        }
+        else
+        {
+            simd_t va(a.constant);
+            for (; i + width <= rows; i += width)
+                applyBinary<Op>(va, load(b.column, i)).copy_to(dst + i, stdx::element_aligned);
+        }
+        for (; i < rows; ++i)
+        {
+            dst[i] = applyBinary<Op>(a.column ? a.column[i] : a.constant, b.column ? b.column[i] : b.constant);
+        }
+    }
+
+    template <OpCode Op>
+    static void blockLoop(const Operand& a, double* dst, size_t rows)
+    {
+        constexpr auto width = simd_t::size();
+        size_t i = 0;
+        for (; i + width <= rows; i += width)
+            applyUnary<Op>(load(a.column, i)).copy_to(dst + i, stdx::element_aligned);
+        for (; i < rows; ++i)
+            dst[i] = applyUnary<Op>(a.column[i]);
+    }
+
+    static void blockLoop(OpCode op, const Operand& a, const Operand& b, double* dst, size_t rows)
+    {
+        switch (op)
+        {
+        case OpCode::Add: return blockLoop<OpCode::Add>(a, b, dst, rows);
+        case OpCode::Sub: return blockLoop<OpCode::Sub>(a, b, dst, rows);
+        case OpCode::Mul: return blockLoop<OpCode::Mul>(a, b, dst, rows);
+        case OpCode::Div: return blockLoop<OpCode::Div>(a, b, dst, rows);
+        case OpCode::Min: return blockLoop<OpCode::Min>(a, b, dst, rows);
+        default:          return blockLoop<OpCode::Max>(a, b, dst, rows);
+        }
+    }
+
+    static void blockLoop(OpCode op, const Operand& a, double* dst, size_t rows)
+    {
+        switch (op)
+        {
+        case OpCode::Neg: return blockLoop<OpCode::Neg>(a, dst, rows);
+        case OpCode::Abs: return blockLoop<OpCode::Abs>(a, dst, rows);
+        default:          return blockLoop<OpCode::Sqrt>(a, dst, rows);
+        }
+    }
+
+    static bool anyZero(const Operand& b, size_t rows)
+    {
+        if (!b.column) return b.constant == 0;
+
+        constexpr auto width = simd_t::size();
+        stdx::native_simd_mask<double> zero(false);
+        size_t i = 0;
+        for (; i + width <= rows; i += width)
+            zero = zero || (load(b.column, i) == 0);
+        for (; i < rows; ++i)
+            if (b.column[i] == 0) return true;
+        return stdx::any_of(zero);
+    }
+
+    template <OpCode Op, bool Trace>
+    static void unary(std::array<double, MaxStack>& stack, size_t top)
+    {
+        auto a = stack[top - 1];
+        stack[top - 1] = applyUnary<Op>(a);
+        if constexpr (Trace)
+        {
+            std::cout<< symbol(Op) << "(" << a << ") = " << stack[top - 1] << "\n";
+        }
+    }
+
+    template <OpCode Op, bool Trace>
+    static void binary(std::array<double, MaxStack>& stack, size_t& top)
+    {
+        auto b = stack[--top];
+        auto a = stack[top - 1];
+        if constexpr (Op == OpCode::Div)
+        {
+            if (b == 0)
+                throw std::invalid_argument("Division by zero");
+        }
+        stack[top - 1] = applyBinary<Op>(a, b);
+        if constexpr (Trace)
+        {
+            std::cout<< a << " " << symbol(Op) << " " << b << " = " << stack[top - 1] << "\n";
+        }
+    }
+
+    template <bool Trace>
+    double run(std::span<const double> variables) const
+    {
+        std::array<double, MaxStack> stack;
+        size_t top = 0;
+
+        for (const auto& [op, index] : m_code)
+        {
+            switch (op)
+            {
+            case OpCode::Constant: stack[top++] = m_constants[index];           break;
+            case OpCode::Variable: stack[top++] = variables[index];             break;
+            case OpCode::Add:      binary<OpCode::Add, Trace>(stack, top);      break;
+            case OpCode::Sub:      binary<OpCode::Sub, Trace>(stack, top);      break;
+            case OpCode::Mul:      binary<OpCode::Mul, Trace>(stack, top);      break;
+            case OpCode::Div:      binary<OpCode::Div, Trace>(stack, top);      break;
+            case OpCode::Min:      binary<OpCode::Min, Trace>(stack, top);      break;
+            case OpCode::Max:      binary<OpCode::Max, Trace>(stack, top);      break;
+            case OpCode::Neg:      unary<OpCode::Neg, Trace>(stack, top);       break;
+            case OpCode::Abs:      unary<OpCode::Abs, Trace>(stack, top);       break;
+            case OpCode::Sqrt:     unary<OpCode::Sqrt, Trace>(stack, top);      break;
+            }
+        }
+        return stack[0];
+    }
+
+    void emitConstant(double value)
+    {
+        m_code.push_back({OpCode::Constant, static_cast<uint32_t>(m_constants.size())});
+        m_constants.push_back(value);
+        grow();
+    }
+
+    void emitVariable(std::string_view name)
+    {
+        uint32_t index = 0;
+        while (index < m_variables.size() && m_variables[index] != name) ++index;
+        if (index == m_variables.size()) m_variables.emplace_back(name);
+
+        m_code.push_back({OpCode::Variable, index});
+        grow();
+    }
+
+    // constant folding: the operands are the last constants emitted
+    void emitOperator(OpCode op)
+    {
+        auto arity = isUnary(op) ? 1u : 2u;
+        if (m_depth < arity)
+            throw std::invalid_argument("Missing operand");
+        m_depth -= arity - 1;
+
+        auto size = m_code.size();
+        bool folded = m_code[size - 1].op == OpCode::Constant && (arity == 1 || m_code[size - 2].op == OpCode::Constant);
+        if (!folded)
+        {
+            m_code.push_back({op, 0});
+            return;
+        }
+
+        auto result = arity == 1
+            ? applyOpCode(op, m_constants.back())
+            : applyOpCode(op, m_constants[m_constants.size() - 2], m_constants.back());
+        m_constants.resize(m_constants.size() - arity);
+        m_code.resize(size - arity);
+        m_code.push_back({OpCode::Constant, static_cast<uint32_t>(m_constants.size())});
+        m_constants.push_back(result);
+    }
+
+    void grow()
+    {
+        if (++m_depth > MaxStack)
+            throw std::invalid_argument("Expression too deep");
+        m_maxDepth = std::max(m_maxDepth, m_depth);
+    }
+
+    std::vector<Instruction> m_code;
+    std::vector<double> m_constants;
+    std::vector<std::string> m_variables;
+    size_t m_depth{0};    // value stack depth while compiling
+    size_t m_maxDepth{0}; // deepest value stack, sizes the batch scratch
+};
+
+void CompiledExpression::evaluateBatch(std::span<const std::span<const double>> columns, std::span<double> out) const
+{
+    if (columns.size() < m_variables.size())
+        throw std::invalid_argument("Missing variable columns");
+    for (size_t i = 0; i < m_variables.size(); ++i)
+    {
+        if (columns[i].size() < out.size())
+            throw std::invalid_argument("Column shorter than output");
+    }
+
+    // one block of rows per stack slot, reused for every block
+    std::vector<double> scratch(m_maxDepth * BatchBlock);
+    std::array<Operand, MaxStack> stack;
+
+    for (size_t row = 0; row < out.size(); row += BatchBlock)
+    {
+        auto rows = std::min(BatchBlock, out.size() - row);
+        size_t top = 0;
+
+        for (const auto& [op, index] : m_code)
+        {
+            switch (op)
+            {
+            case OpCode::Constant: stack[top++] = {nullptr, m_constants[index]};          break;
+            case OpCode::Variable: stack[top++] = {columns[index].data() + row, 0};        break;
+            case OpCode::Neg:
+            case OpCode::Abs:
+            case OpCode::Sqrt:
+            {
+                // operands are never constant here, compile() folded them
+                auto& a = stack[top - 1];
+                double* dst = scratch.data() + (top - 1) * BatchBlock;
+                blockLoop(op, a, dst, rows);
+                a = {dst, 0};
+                break;
+            }
+            default:
+            {
+                auto b = stack[--top];
+                auto& a = stack[top - 1];
+                double* dst = scratch.data() + (top - 1) * BatchBlock;
+                if (op == OpCode::Div && anyZero(b, rows))
+                    throw std::invalid_argument("Division by zero");
+                blockLoop(op, a, b, dst, rows);
+                a = {dst, 0};
+            }
+            }
+        }
+
+        const auto& result = stack[0];
+        if (result.column)
+            std::copy(result.column, result.column + rows, out.data() + row);
+        else
+            std::fill(out.data() + row, out.data() + row + rows, result.constant);
+    }
+}
+
+// Shunting-yard over the tokenizer, operators are emitted as bytecode instead
+// of being applied
+CompiledExpression CompiledExpression::compile(std::string_view infix)
+{
+    // operator stack entry: a pending operator, or an open parenthesis
+    // (op is the function for a call, OpCode::Constant for a plain group)
+    struct Pending
+    {
+        bool paren;
+        OpCode op;
+        size_t arguments; // commas seen + 1, for a call
+    };
+
+    auto priority = [](OpCode op)
+    {
+        if (isUnary(op)) return 3;
+        return precedence(symbol(op)[0]);
+    };
+
+    CompiledExpression expr;
+    std::vector<Pending> ops; // Stack to store operators
+    bool expectOperand = true;
+
+    auto reduceToParen = [&]()
+    {
+        while (!ops.empty() && !ops.back().paren)
+        {
+            expr.emitOperator(ops.back().op);
+            ops.pop_back();
+        }
+        if (ops.empty())
+            throw std::invalid_argument("Unbalanced parenthesis");
+    };
+
+    auto operand = [&]()
+    {
+        if (!expectOperand)
+            throw std::invalid_argument("Missing operator");
+        expectOperand = false;
+    };
+
+    Tokenizer tokenizer(infix);
+    for (auto token = tokenizer.next(); token.kind != TokenKind::End; token = tokenizer.next())
+    {
+        switch (token.kind)
+        {
+        case TokenKind::Number:
+            operand();
+            expr.emitConstant(token.number);
+            break;
+
+        case TokenKind::Identifier:
+            operand();
+            expr.emitVariable(token.text);
+            break;
+
+        case TokenKind::Function:
+        {
+            if (!expectOperand)
+                throw std::invalid_argument("Missing operator");
+            auto [op, arity] = toFunction(token.text);
+            tokenizer.next(); // the '(' that made it a call
+            ops.push_back({true, op, 1});
+            break;
+        }
+
+        case TokenKind::Negate:
+            ops.push_back({false, OpCode::Neg, 0}); // prefix, nothing to reduce
+            break;
+
+        case TokenKind::LeftParen:
+            if (!expectOperand)
+                throw std::invalid_argument("Missing operator");
+            ops.push_back({true, OpCode::Constant, 0});
+            break;
+
+        case TokenKind::Comma:
+            reduceToParen();
+            if (ops.back().op == OpCode::Constant)
+                throw std::invalid_argument("Comma outside a function call");
+            ++ops.back().arguments;
+            expectOperand = true;
+            break;
+
+        case TokenKind::RightParen:
+        {
+            if (expectOperand)
+                throw std::invalid_argument("Missing operand");
+            reduceToParen();
+            auto paren = ops.back();
+            ops.pop_back(); // Pop the left parenthesis
+            if (paren.op != OpCode::Constant)
+            {
+                if (paren.arguments != toFunction(symbol(paren.op)).second)
+                    throw std::invalid_argument("Wrong number of arguments");
+                expr.emitOperator(paren.op);
+            }
+            break;
+        }
+
+        case TokenKind::Operator:
+        {
+            if (expectOperand)
+                throw std::invalid_argument("Missing operand");
+            auto op = toOpCode(token.op);
+            while (!ops.empty() && !ops.back().paren && priority(ops.back().op) >= priority(op))
+            {
+                expr.emitOperator(ops.back().op);
+                ops.pop_back();
+            }
+            ops.push_back({false, op, 0});
+            expectOperand = true;
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    if (expectOperand)
+        throw std::invalid_argument("Missing operand");
+
+    while (!ops.empty())
+    {
+        if (ops.back().paren)
+            throw std::invalid_argument("Unbalanced parenthesis");
+        expr.emitOperator(ops.back().op);
+        ops.pop_back();
+    }
+
+    if (expr.m_depth != 1)
+        throw std::invalid_argument("Malformed expression");
+
+    return expr;
+}
+
+// Formulas known at build time: no interpreter at all.
+// The string literal is parsed by consteval functions into a nested expression
+// template type, e.g. "2 * (x + 1)" becomes
+//      BinaryNode<'*', ConstantNode<2>, BinaryNode<'+', VariableNode<0>, ConstantNode<1>>>
+// so evaluate() inlines to straight-line arithmetic on its arguments.
+// Same grammar as compile(): decimal numbers with an optional exponent, + - * /, unary minus, parentheses
+// and the functions min, max, abs and sqrt; errors are compile errors.
+// Variables are bound by position, in order of first appearance in the formula.
+template <size_t N>
+struct FixedString
+{
+    char data[N]{};
+
+    consteval FixedString(const char (&str)[N])
+    {
+        for (size_t i = 0; i < N; ++i) data[i] = str[i];
+    }
+
+    constexpr size_t size() const { return N - 1; }
+    constexpr char operator[](size_t i) const { return i < N - 1 ? data[i] : '\0'; }
+};
+
+template <double Value>
+struct ConstantNode
+{
+    static constexpr double eval(const double*) { return Value; }
+};
+
+template <size_t Index>
+struct VariableNode
+{
+    static constexpr double eval(const double* vars) { return vars[Index]; }
+};
+
+template <char Op, typename L, typename R>
+struct BinaryNode
+{
+    static constexpr double eval(const double* vars)
+    {
+        auto a = L::eval(vars);
+        auto b = R::eval(vars);
+        if constexpr (Op == '+') return a + b;
+        if constexpr (Op == '-') return a - b;
+        if constexpr (Op == '*') return a * b;
+        if constexpr (Op == '/')
+        {
+            // in a constant evaluation the throw turns into a compile error
+            if (b == 0)
+                throw std::invalid_argument("Division by zero");
+            return a / b;
+        }
+    }
+};
+
+// unary minus and the functions
+template <OpCode Op, typename... Args>
+struct CallNode
+{
+    static constexpr double eval(const double* vars)
+    {
+        const double args[] = {Args::eval(vars)...};
+        if constexpr (Op == OpCode::Min) return args[1] < args[0] ? args[1] : args[0]; // as std::min
+        if constexpr (Op == OpCode::Max) return args[0] < args[1] ? args[1] : args[0]; // as std::max
+        if constexpr (Op == OpCode::Neg) return -args[0];
+        if constexpr (Op == OpCode::Abs) return args[0] < 0 ? -args[0] : args[0];
+        if constexpr (Op == OpCode::Sqrt) return __builtin_sqrt(args[0]); // std::sqrt is not constexpr before C++26
+    }
+};
+
+namespace static_expr
+{
+    constexpr bool isIdentStart(char ch) { return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_'; }
+    constexpr bool isIdent(char ch) { return isIdentStart(ch) || (ch >= '0' && ch <= '9'); }
+    constexpr bool isDigit(char ch) { return ch >= '0' && ch <= '9'; }
+
+    template <FixedString S>
+    constexpr size_t skipSpaces(size_t pos)
+    {
+        while (S[pos] == ' ') ++pos;
+        return pos;
+    }
+
+    template <FixedString S>
+    constexpr size_t identEnd(size_t pos)
+    {
+        while (isIdent(S[pos])) ++pos;
+        return pos;
+    }
+
+    template <FixedString S>
+    constexpr bool sameIdent(size_t a, size_t b)
+    {
+        while (isIdent(S[a]) && S[a] == S[b]) { ++a; ++b; }
+        return !isIdent(S[a]) && !isIdent(S[b]);
+    }
+
+    // an identifier followed by '(' is a function name, not a variable
+    template <FixedString S>
+    constexpr bool isCall(size_t pos)
+    {
+        return S[skipSpaces<S>(identEnd<S>(pos))] == '(';
+    }
+
+    // the function named at pos and its argument count, {OpCode::Constant, 0} if unknown
+    template <FixedString S>
+    constexpr std::pair<OpCode, size_t> function(size_t pos)
+    {
+        auto is = [&](std::string_view name)
+        {
+            for (size_t i = 0; i < name.size(); ++i)
+            {
+                if (S[pos + i] != name[i]) return false;
+            }
+            return identEnd<S>(pos) == pos + name.size();
+        };
+        if (is("min"))  return {OpCode::Min, 2};
+        if (is("max"))  return {OpCode::Max, 2};
+        if (is("abs"))  return {OpCode::Abs, 1};
+        if (is("sqrt")) return {OpCode::Sqrt, 1};
+        return {OpCode::Constant, 0};
+    }
+
+    // Calls f(position) for the first occurrence of every distinct identifier
+    template <FixedString S, typename F>
+    constexpr void forEachVariable(F f)
+    {
+        for (size_t pos = 0; pos < S.size();)
+        {
+            if (!isIdentStart(S[pos]) || (pos > 0 && isIdent(S[pos - 1])))
+            {
+                ++pos;
+                continue;
+            }
+            if (isCall<S>(pos))
+            {
+                pos = identEnd<S>(pos);
+                continue;
+            }
+            bool seen = false;
+            for (size_t prev = 0; prev < pos; ++prev)
+            {
+                if (isIdentStart(S[prev]) && (prev == 0 || !isIdent(S[prev - 1])) && !isCall<S>(prev) && sameIdent<S>(prev, pos)) seen = true;
+            }
+            if (!seen) f(pos);
+            pos = identEnd<S>(pos);
+        }
+    }
+
+    template <FixedString S>
+    constexpr size_t variableCount()
+    {
+        size_t count = 0;
+        forEachVariable<S>([&](size_t) { ++count; });
+        return count;
+    }
+
+    template <FixedString S>
+    constexpr size_t variableIndex(size_t pos)
+    {
+        size_t index = 0, found = 0;
+        forEachVariable<S>([&](size_t first) {
+            if (sameIdent<S>(first, pos)) found = index;
+            ++index;
+        });
+        return found;
+    }
+
+    // position of the exponent digits after "e", "e+" or "e-" at pos, 0 if there is no exponent
+    // (as from_chars: an 'e' without digits is not part of the number)
+    template <FixedString S>
+    constexpr size_t exponentDigits(size_t pos)
+    {
+        if (S[pos] != 'e' && S[pos] != 'E') return 0;
+        ++pos;
+        if (S[pos] == '+' || S[pos] == '-') ++pos;
+        return isDigit(S[pos]) ? pos : 0;
+    }
+
+    // digits with an optional fraction and exponent, "2", "2.5", ".5" or "1.5e-3":
+    // the digits as an integer times a power of ten, correctly rounded below 2^53 and 1e22
+    template <FixedString S>
+    constexpr double parseNumber(size_t pos)
+    {
+        double mantissa = 0;
+        int exponent = 0;
+        for (bool fraction = false; isDigit(S[pos]) || (S[pos] == '.' && !fraction); ++pos)
+        {
+            if (S[pos] == '.')
+            {
+                fraction = true;
+                continue;
+            }
+            mantissa = mantissa * 10 + (S[pos] - '0');
+            if (fraction) --exponent;
+        }
+        if (auto digits = exponentDigits<S>(pos))
+        {
+            int value = 0;
+            for (pos = digits; isDigit(S[pos]); ++pos) value = value * 10 + (S[pos] - '0');
+            exponent += S[digits - 1] == '-' ? -value : value;
+        }
+        double scale = 1;
+        for (int i = 0; i < (exponent < 0 ? -exponent : exponent); ++i) scale *= 10;
+        return exponent < 0 ? mantissa / scale : mantissa * scale;
+    }
+
+    template <FixedString S>
+    constexpr size_t numberEnd(size_t pos)
+    {
+        while (isDigit(S[pos])) ++pos;
+        if (S[pos] == '.') ++pos;
+        while (isDigit(S[pos])) ++pos;
+        if (auto digits = exponentDigits<S>(pos))
+        {
+            for (pos = digits; isDigit(S[pos]); ++pos) {}
+        }
+        return pos;
+    }
+
+    // Each parser is a type: `type` is the node parsed from position Pos, `end` the position after it
+    template <typename Node, size_t End>
+    struct Parsed
+    {
+        using type = Node;
+        static constexpr size_t end = End;
+    };
+
+    template <FixedString S, size_t Pos> struct Expr;
+
+    template <FixedString S, size_t Pos>
+    struct Primary
+    {
+        static constexpr size_t pos = skipSpaces<S>(Pos);
+
+        static consteval auto parse()
+        {
+            if constexpr (S[pos] == '(')
+            {
+                using Inner = Expr<S, pos + 1>;
+                static_assert(S[skipSpaces<S>(Inner::end)] == ')', "Unbalanced parenthesis");
+                return Parsed<typename Inner::type, skipSpaces<S>(Inner::end) + 1>{};
+            }
+            else if constexpr (isDigit(S[pos]) || S[pos] == '.')
+            {
+                static_assert(numberEnd<S>(pos) > pos + 1 || isDigit(S[pos]), "Invalid number");
+                return Parsed<ConstantNode<parseNumber<S>(pos)>, numberEnd<S>(pos)>{};
+            }
+            else if constexpr (isIdentStart(S[pos]) && isCall<S>(pos))
+            {
+                constexpr auto fn = function<S>(pos);
+                static_assert(fn.first != OpCode::Constant, "Unknown function");
+                using First = Expr<S, skipSpaces<S>(identEnd<S>(pos)) + 1>;
+                constexpr size_t next = skipSpaces<S>(First::end);
+                if constexpr (fn.second == 2)
+                {
+                    static_assert(S[next] == ',', "Wrong number of arguments");
+                    using Second = Expr<S, next + 1>;
+                    static_assert(S[skipSpaces<S>(Second::end)] == ')', "Wrong number of arguments");
+                    return Parsed<CallNode<fn.first, typename First::type, typename Second::type>, skipSpaces<S>(Second::end) + 1>{};
+                }
+                else
+                {
+                    static_assert(S[next] == ')', "Wrong number of arguments");
+                    return Parsed<CallNode<fn.first, typename First::type>, next + 1>{};
+                }
+            }
+            else
+            {
+                static_assert(isIdentStart(S[pos]), "Unknown input");
+                return Parsed<VariableNode<variableIndex<S>(pos)>, identEnd<S>(pos)>{};
+            }
+        }
+
+        using type = typename decltype(parse())::type;
+        static constexpr size_t end = decltype(parse())::end;
+    };
+
+    // left-associative tail: Lhs (op Next)*, where Next parses one operand of the level
+    template <FixedString S, size_t Pos, typename Lhs, template <FixedString, size_t> class Next, char Op1, char Op2>
+    struct Tail
+    {
+        static constexpr size_t pos = skipSpaces<S>(Pos);
+
+        static consteval auto parse()
+        {
+            if constexpr (S[pos] == Op1 || S[pos] == Op2)
+            {
+                using Rhs = Next<S, pos + 1>;
+                using Rest = Tail<S, Rhs::end, BinaryNode<S[pos], Lhs, typename Rhs::type>, Next, Op1, Op2>;
+                return Parsed<typename Rest::type, Rest::end>{};
+            }
+            else
+            {
+                return Parsed<Lhs, Pos>{};
+            }
+        }
+
+        using type = typename decltype(parse())::type;
+        static constexpr size_t end = decltype(parse())::end;
+    };
+
+    // unary minus binds tighter than * and /, as in compile()
+    template <FixedString S, size_t Pos>
+    struct Unary
+    {
+        static constexpr size_t pos = skipSpaces<S>(Pos);
+
+        static consteval auto parse()
+        {
+            if constexpr (S[pos] == '-')
+            {
+                using Operand = Unary<S, pos + 1>;
+                return Parsed<CallNode<OpCode::Neg, typename Operand::type>, Operand::end>{};
+            }
+            else
+            {
+                return Parsed<typename Primary<S, pos>::type, Primary<S, pos>::end>{};
+            }
+        }
+
+        using type = typename decltype(parse())::type;
+        static constexpr size_t end = decltype(parse())::end;
+    };
+
+    template <FixedString S, size_t Pos>
+    struct Term
+    {
+        using First = Unary<S, Pos>;
+        using Rest = Tail<S, First::end, typename First::type, Unary, '*', '/'>;
+        using type = typename Rest::type;
+        static constexpr size_t end = Rest::end;
+    };
+
+    template <FixedString S, size_t Pos>
+    struct Expr
+    {
+        using First = Term<S, Pos>;
+        using Rest = Tail<S, First::end, typename First::type, Term, '+', '-'>;
+        using type = typename Rest::type;
+        static constexpr size_t end = Rest::end;
+    };
+}
+
+template <FixedString S>
+struct StaticExpression
+{
+    using type = typename static_expr::Expr<S, 0>::type;
+    static_assert(static_expr::skipSpaces<S>(static_expr::Expr<S, 0>::end) == S.size(), "Malformed expression");
+
+    static constexpr size_t variableCount = static_expr::variableCount<S>();
+
+    // one argument per variable, in order of first appearance
+    template <typename... Args>
+        requires (sizeof...(Args) == variableCount)
+    static constexpr double evaluate(Args... args)
+    {
+        const std::array<double, sizeof...(Args) + 1> vars{static_cast<double>(args)...};
+        return type::eval(vars.data());
+    }
+};
+
+static_assert(StaticExpression<"2 * (3 + 4) - 10 / 5">::evaluate() == 12);
+static_assert(StaticExpression<"(x + 3) * (y - x)">::evaluate(1, 5) == 16);
+static_assert(std::is_same_v<StaticExpression<"a - b">::type, BinaryNode<'-', VariableNode<0>, VariableNode<1>>>);
+static_assert(StaticExpression<"-2.5 * -x + .5">::evaluate(2) == 5.5);
+static_assert(StaticExpression<"max(abs(x - y), sqrt(16)) + min(x, -y)">::evaluate(1, 9) == 8 - 9);
+static_assert(StaticExpression<"sqrt(x) * sqrt(x)">::variableCount == 1);
+static_assert(StaticExpression<"-1.5e1 + 25E-1 * 2e+1">::evaluate() == 35);
+
+// re-parse per row vs compile once
+void benchmarkCompiled()
+{
+    constexpr int Rows = 200'000;
+    auto expr = CompiledExpression::compile("(x + 3) * (y - 2 * 4) / 2");
+    auto x = expr.variableIndex("x");
+    auto y = expr.variableIndex("y");
+
+    double sum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int row = 0; row < Rows; ++row)
+    {
+        sum += evaluateInfix("(" + std::to_string(row) + " + 3) * (" + std::to_string(row + 9) + " - 2 * 4) / 2");
+    }
+    auto middle = std::chrono::steady_clock::now();
+    std::array<double, 2> values;
+    for (int row = 0; row < Rows; ++row)
+    {
+        values[x] = row;
+        values[y] = row + 9;
+        sum -= expr.evaluate(values);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    using ns = std::chrono::duration<double, std::nano>;
+    std::cout << "evaluateInfix: " << ns(middle - begin).count() / Rows << " ns/row\n";
+    std::cout << "compiled:      " << ns(end - middle).count() / Rows << " ns/row"
+              << " (checksum " << sum << ")\n";
+}
+
+// per-row evaluate vs one batch call over the columns
+void benchmarkBatch()
+{
+    constexpr size_t Rows = 1'000'000;
+    auto expr = CompiledExpression::compile("(x + 3) * (y - 2 * 4) / 2 - x * y");
+
+    std::vector<double> x(Rows), y(Rows), perRow(Rows), batch(Rows);
+    for (size_t row = 0; row < Rows; ++row)
+    {
+        x[row] = row * 0.5;
+        y[row] = row + 9.0;
+    }
+
+    auto ix = expr.variableIndex("x");
+    auto iy = expr.variableIndex("y");
+
+    auto begin = std::chrono::steady_clock::now();
+    std::array<double, 2> values;
+    for (size_t row = 0; row < Rows; ++row)
+    {
+        values[ix] = x[row];
+        values[iy] = y[row];
+        perRow[row] = expr.evaluate(values);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    std::array<std::span<const double>, 2> columns;
+    columns[ix] = x;
+    columns[iy] = y;
+    expr.evaluateBatch(columns, batch);
+    auto end = std::chrono::steady_clock::now();
+
+    using ns = std::chrono::duration<double, std::nano>;
+    std::cout << "per row:  " << ns(middle - begin).count() / Rows << " ns/row\n";
+    std::cout << "batch:    " << ns(end - middle).count() / Rows << " ns/row"
+              << (perRow == batch ? "" : " (MISMATCH)") << "\n";
+}
+
+// runtime parse vs build-time expression template
+void benchmarkStatic()
+{
+    constexpr int Rows = 200'000;
+    using Formula = StaticExpression<"(x + 3) * (y - 2 * 4) / 2">;
+
+    double sumInfix = 0, sumStatic = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int row = 0; row < Rows; ++row)
+    {
+        sumInfix += evaluateInfix("(" + std::to_string(row) + " + 3) * (" + std::to_string(row + 9) + " - 2 * 4) / 2");
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int row = 0; row < Rows; ++row)
+    {
+        sumStatic += Formula::evaluate(row, row + 9);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    using ns = std::chrono::duration<double, std::nano>;
+    std::cout << "evaluateInfix:    " << ns(middle - begin).count() / Rows << " ns/row\n";
+    std::cout << "StaticExpression: " << ns(end - middle).count() / Rows << " ns/row"
+              << (sumInfix == sumStatic ? "" : " (MISMATCH)") << "\n";
+}
+
+// tokenizer throughput over a large batch of formulas
+void benchmarkTokenizer()
+{
+    constexpr int Formulas = 100'000;
+
+    std::string batch;
+    for (int i = 0; i < Formulas; ++i)
+    {
+        batch += "-" + std::to_string(i) + ".25e-3 * max(rate_" + std::to_string(i % 7)
+               + ", 2.5) + sqrt(abs(fee - " + std::to_string(i) + ")) / 4 + min(x, -y);";
+    }
+
+    size_t tokens = 0;
+    double checksum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    std::string_view rest(batch);
+    while (!rest.empty())
+    {
+        auto end = rest.find(';');
+        Tokenizer tokenizer(rest.substr(0, end));
+        for (auto token = tokenizer.next(); token.kind != TokenKind::End; token = tokenizer.next())
+        {
+            checksum += token.number;
+            ++tokens;
+        }
+        rest.remove_prefix(end + 1);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "tokenizer: " << batch.size() / seconds / 1e6 << " MB/s, "
+              << tokens / seconds / 1e6 << " Mtokens/s (checksum " << checksum << ")\n";
+}
+
+// benchmarks only with "bench"
+int main(int argc, char* argv[])
 {
     try
     {
@@ -132,6 +1273,24 @@ int main()
         // Evaluate the infix expression directly
         int result = evaluateInfix(infix);
         std::cout << "Result: " << result << std::endl;
+
+        auto expr = CompiledExpression::compile("2 * (3 + 4) * rate - fee / 2");
+        std::cout << "Bytecode: " << expr.code().size() << " instructions, "
+                  << expr.variables().size() << " variables" << std::endl;
+        auto value = expr.evaluate(std::array{1.5, 10.0}, true);
+        std::cout << "Result: " << value << std::endl;
+
+        auto call = CompiledExpression::compile("-1.5e1 + max(x, 2.5) * sqrt(abs(-16)) / .5");
+        auto called = call.evaluate(std::array{4.0}, true);
+        std::cout << "Result: " << called << std::endl;
+
+        if (argc > 1 && std::string_view(argv[1]) == "bench")
+        {
+            benchmarkTokenizer();
+            benchmarkCompiled();
+            benchmarkBatch();
+            benchmarkStatic();
+        }
     }
     catch (const std::exception &ex)
     {
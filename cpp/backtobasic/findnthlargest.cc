@@ -3,88 +3,386 @@
 #include <algorithm>
 #include <iterator>
 #include <queue>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <immintrin.h>
+
+// Vectorized scanning kernels used by the selection and top-k paths below.
+// Every kernel has a scalar version plus AVX2/AVX-512 versions compiled with a
+// target attribute, so the file still builds without -mavx2 and the best one is
+// picked once at runtime from the CPU features.
+// g++ -std=c++20 -O2 findnthlargest.cc -o findnthlargest
+namespace kernels {
+
+struct MinMax {
+    int min;
+    int max;
+};
+
+// number of elements > threshold
+size_t countGreaterScalar(const int* data, size_t size, int threshold) {
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i) {
+        count += data[i] > threshold;
+    }
+    return count;
+}
+
+MinMax minMaxScalar(const int* data, size_t size) {
+    MinMax result{data[0], data[0]};
+    for (size_t i = 1; i < size; ++i) {
+        result.min = std::min(result.min, data[i]);
+        result.max = std::max(result.max, data[i]);
+    }
+    return result;
+}
+
+// Copy elements < pivot to less[] and elements > pivot to greater[], both packed
+// from the front. Elements equal to the pivot are only counted (size - less - greater).
+// Both outputs need `size + 16` slots: the AVX2 kernel stores whole registers.
+std::pair<size_t, size_t> partitionScalar(const int* data, size_t size, int pivot, int* less, int* greater) {
+    size_t lt = 0, gt = 0;
+    for (size_t i = 0; i < size; ++i) {
+        auto value = data[i];
+        less[lt] = value;
+        greater[gt] = value;
+        lt += value < pivot;    // branchless: write always, advance only on match
+        gt += value > pivot;
+    }
+    return {lt, gt};
+}
+
+__attribute__((target("avx2")))
+size_t countGreaterAvx2(const int* data, size_t size, int threshold) {
+    auto limit = _mm256_set1_epi32(threshold);
+    auto acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        acc = _mm256_sub_epi32(acc, _mm256_cmpgt_epi32(v, limit)); // true lanes are -1
+    }
+    alignas(32) std::array<uint32_t, 8> lanes;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes.data()), acc);
+    size_t count = 0;
+    for (auto lane : lanes) count += lane;
+    return count + countGreaterScalar(data + i, size - i, threshold);
+}
+
+__attribute__((target("avx2")))
+MinMax minMaxAvx2(const int* data, size_t size) {
+    if (size < 8) return minMaxScalar(data, size);
+
+    auto vmin = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    auto vmax = vmin;
+    size_t i = 8;
+    for (; i + 8 <= size; i += 8) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        vmin = _mm256_min_epi32(vmin, v);
+        vmax = _mm256_max_epi32(vmax, v);
+    }
+    alignas(32) std::array<int, 8> mins, maxs;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(mins.data()), vmin);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(maxs.data()), vmax);
+    MinMax result{*std::min_element(mins.begin(), mins.end()), *std::max_element(maxs.begin(), maxs.end())};
+    for (; i < size; ++i) {
+        result.min = std::min(result.min, data[i]);
+        result.max = std::max(result.max, data[i]);
+    }
+    return result;
+}
+
+// AVX2 has no compress-store, emulate it: for every 8-bit mask, the lane indices
+// of the set bits packed to the front (permutevar8x32 then store the whole register).
+constexpr auto makeCompressTable() {
+    std::array<std::array<int, 8>, 256> table{};
+    for (int mask = 0; mask < 256; ++mask) {
+        int out = 0;
+        for (int lane = 0; lane < 8; ++lane) {
+            if (mask & (1 << lane)) table[mask][out++] = lane;
+        }
+    }
+    return table;
+}
+alignas(32) constexpr auto compressTable = makeCompressTable();
+
+__attribute__((target("avx2")))
+std::pair<size_t, size_t> partitionAvx2(const int* data, size_t size, int pivot, int* less, int* greater) {
+    auto vpivot = _mm256_set1_epi32(pivot);
+    size_t lt = 0, gt = 0, i = 0;
+    for (; i + 8 <= size; i += 8) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        auto maskLess = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vpivot, v)));
+        auto maskGreater = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, vpivot)));
+
+        auto idxLess = _mm256_load_si256(reinterpret_cast<const __m256i*>(compressTable[maskLess].data()));
+        auto idxGreater = _mm256_load_si256(reinterpret_cast<const __m256i*>(compressTable[maskGreater].data()));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(less + lt), _mm256_permutevar8x32_epi32(v, idxLess));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(greater + gt), _mm256_permutevar8x32_epi32(v, idxGreater));
+        lt += __builtin_popcount(maskLess);
+        gt += __builtin_popcount(maskGreater);
+    }
+    auto [tailLess, tailGreater] = partitionScalar(data + i, size - i, pivot, less + lt, greater + gt);
+    return {lt + tailLess, gt + tailGreater};
+}
+
+__attribute__((target("avx512f")))
+size_t countGreaterAvx512(const int* data, size_t size, int threshold) {
+    auto limit = _mm512_set1_epi32(threshold);
+    size_t count = 0, i = 0;
+    for (; i + 16 <= size; i += 16) {
+        auto v = _mm512_loadu_si512(data + i);
+        count += __builtin_popcount(_mm512_cmpgt_epi32_mask(v, limit));
+    }
+    return count + countGreaterScalar(data + i, size - i, threshold);
+}
+
+__attribute__((target("avx512f")))
+MinMax minMaxAvx512(const int* data, size_t size) {
+    if (size < 16) return minMaxScalar(data, size);
+
+    auto vmin = _mm512_loadu_si512(data);
+    auto vmax = vmin;
+    size_t i = 16;
+    // the maskz forms with a full mask: the plain ones and _mm512_reduce_* start
+    // from _mm512_undefined_*, which trips -Wmaybe-uninitialized
+    for (; i + 16 <= size; i += 16) {
+        auto v = _mm512_loadu_si512(data + i);
+        vmin = _mm512_maskz_min_epi32(0xFFFF, vmin, v);
+        vmax = _mm512_maskz_max_epi32(0xFFFF, vmax, v);
+    }
+    alignas(64) std::array<int, 16> mins, maxs;
+    _mm512_store_si512(mins.data(), vmin);
+    _mm512_store_si512(maxs.data(), vmax);
+    MinMax result{*std::min_element(mins.begin(), mins.end()), *std::max_element(maxs.begin(), maxs.end())};
+    for (; i < size; ++i) {
+        result.min = std::min(result.min, data[i]);
+        result.max = std::max(result.max, data[i]);
+    }
+    return result;
+}
+
+__attribute__((target("avx512f")))
+std::pair<size_t, size_t> partitionAvx512(const int* data, size_t size, int pivot, int* less, int* greater) {
+    auto vpivot = _mm512_set1_epi32(pivot);
+    size_t lt = 0, gt = 0, i = 0;
+    for (; i + 16 <= size; i += 16) {
+        auto v = _mm512_loadu_si512(data + i);
+        auto maskLess = _mm512_cmplt_epi32_mask(v, vpivot);
+        auto maskGreater = _mm512_cmpgt_epi32_mask(v, vpivot);
+        _mm512_mask_compressstoreu_epi32(less + lt, maskLess, v);
+        _mm512_mask_compressstoreu_epi32(greater + gt, maskGreater, v);
+        lt += __builtin_popcount(maskLess);
+        gt += __builtin_popcount(maskGreater);
+    }
+    auto [tailLess, tailGreater] = partitionScalar(data + i, size - i, pivot, less + lt, greater + gt);
+    return {lt + tailLess, gt + tailGreater};
+}
+
+// Resolved once, the first time a kernel is called
+struct Dispatch {
+    const char* name;
+    size_t (*countGreater)(const int*, size_t, int);
+    MinMax (*minMax)(const int*, size_t);
+    std::pair<size_t, size_t> (*partition)(const int*, size_t, int, int*, int*);
+};
+
+constexpr Dispatch scalar{"scalar", countGreaterScalar, minMaxScalar, partitionScalar};
+constexpr Dispatch avx2{"avx2", countGreaterAvx2, minMaxAvx2, partitionAvx2};
+constexpr Dispatch avx512{"avx512", countGreaterAvx512, minMaxAvx512, partitionAvx512};
+
+const Dispatch& best() {
+    static const Dispatch& selected = []() -> const Dispatch& {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return avx512;
+        if (__builtin_cpu_supports("avx2")) return avx2;
+        return scalar;
+    }();
+    return selected;
+}
+
+size_t countGreater(const int* data, size_t size, int threshold) { return best().countGreater(data, size, threshold); }
+MinMax minMax(const int* data, size_t size) { return best().minMax(data, size); }
+std::pair<size_t, size_t> partition(const int* data, size_t size, int pivot, int* less, int* greater) {
+    return best().partition(data, size, pivot, less, greater);
+}
+
+} // namespace kernels
 
 // Partition function to rearrange elements around the pivot.
+// Three-way and out-of-place: the kernel splits [begin, end) into scratch buffers,
+// which are copied back as [less | equal to pivot | greater].
+// Returns the range holding the pivot value.
+// T is a contiguous container of int: the kernels work on int arrays.
 template <typename T>
-typename T::iterator partition(typename T::iterator begin, typename T::iterator end, typename T::iterator pivot) {
-    auto left = begin, right = end - 1;
+std::pair<typename T::iterator, typename T::iterator> partition(typename T::iterator begin, typename T::iterator end,
+                                                                 int pivot, std::vector<int>& scratch) {
+    static_assert(std::is_same_v<typename T::value_type, int> && std::contiguous_iterator<typename T::iterator>,
+                  "the partition kernels work on contiguous int");
+    auto size = static_cast<size_t>(end - begin);
+    int* less = scratch.data();
+    int* greater = scratch.data() + size + 16;
+    auto [lt, gt] = kernels::partition(&*begin, size, pivot, less, greater);
 
-    while (true) {
-        // Move left iterator to the right past elements less than pivot
-        while (*left < *pivot) {
-            ++left;
-        }
-        // Move right iterator to the left past elements greater than pivot
-        while (*right > *pivot) {
-            --right;
-        }
+    std::copy(less, less + lt, begin);
+    std::fill(begin + lt, end - gt, pivot);
+    std::copy(greater, greater + gt, end - gt);
+    return {begin + lt, end - gt};
+}
+
+// scratch buffer of partition() for a range of size elements
+inline size_t scratchSize(size_t size) { return 2 * (size + 16); }
+
+// Quickselect-like partitioning to find nth element; scratch is grown as needed
+// and can be reused across calls
+template <typename T>
+void nth_element_impl(typename T::iterator begin, typename T::iterator end, typename T::iterator nth,
+                      std::vector<int>& scratch) {
+    static_assert(std::is_same_v<typename T::value_type, int> && std::contiguous_iterator<typename T::iterator>,
+                  "the selection kernels work on contiguous int");
+    if (end - begin <= 1) {
+        return;
+    }
+    // once up front: inside the loop the three-way partition already stops on a
+    // range of equal values (it is all pivot)
+    auto [lo, hi] = kernels::minMax(&*begin, end - begin);
+    if (lo == hi) {
+        return; // every element is equal, nth is already in place
+    }
 
-        // If both iterators haven't crossed, swap the elements
-        if (left < right) {
-            std::swap(*left, *right);
-            ++left;
-            --right;
+    if (scratch.size() < scratchSize(static_cast<size_t>(end - begin))) {
+        scratch.resize(scratchSize(static_cast<size_t>(end - begin)));
+    }
+    while (end - begin > 1) {
+        // median of three, the middle element alone degrades on sorted input
+        int a = *begin, b = *(begin + (end - begin) / 2), c = *(end - 1);
+        int pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+        auto [equalBegin, equalEnd] = partition<T>(begin, end, pivot, scratch);
+        if (nth < equalBegin) {
+            end = equalBegin; // Look in the left half
+        } else if (nth >= equalEnd) {
+            begin = equalEnd; // Look in the right half
         } else {
-            return left; // Return the partition index
+            return; // nth element is found
         }
     }
 }
 
-// Quickselect-like partitioning to find nth element
-template <typename T>
-void nth_element_impl(typename T::iterator begin, typename T::iterator end, typename T::iterator nth) {
-    if (begin == end) return;
-    
-    auto pivot = begin + (end - begin) / 2; // Choose a pivot (middle element for simplicity)
-    pivot = partition<T>(begin, end, pivot);
-    
-    if (pivot == nth) {
-        return; // nth element is found
-    } else if (pivot < nth) {
-        nth_element_impl<T>(pivot, end, nth); // Look in the right half
-    } else {
-        nth_element_impl<T>(begin, pivot, nth); // Look in the left half
-    }
-}
-
-// nth_element function
+// nth_element function; hot paths pass their own scratch to avoid an allocation per call
 template <typename T>
-void nth_element(T& arr, size_t n) {
-    if (n < 0 || n >= arr.size()) {
+void nth_element(T& arr, size_t n, std::vector<int>& scratch) {
+    if (n >= arr.size()) {
         throw std::out_of_range("Index out of range");
     }
 
-    nth_element_impl<T>(arr.begin(), arr.end(), arr.begin() + n);
+    nth_element_impl<T>(arr.begin(), arr.end(), arr.begin() + n, scratch);
+}
+
+template <typename T>
+void nth_element(T& arr, size_t n) {
+    std::vector<int> scratch;
+    nth_element(arr, n, scratch);
+}
+
+// n-th largest with a min-heap of size n.
+// Blocks that hold nothing above the current heap top cannot change the result,
+// so they are rejected with one vector count instead of n heap compares.
+int nthLargest(const std::vector<int>& arr, size_t n) {
+    constexpr size_t Block = 64;
+
+    std::priority_queue<int, std::vector<int>, std::greater<int>> minHeap;
+    for (size_t begin = 0; begin < arr.size(); begin += Block) {
+        auto size = std::min(Block, arr.size() - begin);
+        const int* block = arr.data() + begin;
+
+        if (minHeap.size() == n && kernels::countGreater(block, size, minHeap.top()) == 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            if (minHeap.size() < n) {
+                minHeap.push(block[i]);
+            } else if (block[i] > minHeap.top()) {
+                minHeap.pop();  // Remove the smallest element to keep only n largest
+                minHeap.push(block[i]);
+            }
+        }
+    }
+    return minHeap.top();
 }
 
 void mostEffecient(std::vector<int> arr, int n)
 {
     nth_element(arr, n - 1); // Find the 3rd largest element (index n-1)
-    
+
     std::cout << "The " << n << "th element is: " << arr[n - 1] << std::endl;
-} 
+}
 
 void secondEffect(std::vector<int> arr, int n)
 {
-    // Min-heap to store the n largest elements
-    std::priority_queue<int, std::vector<int>, std::greater<int>> minHeap;
+    // The n-th largest element is at the top of the min-heap
+    std::cout << "The " << n << "-th largest element is: " << nthLargest(arr, n) << std::endl;
+}
+
+// per-element cost of every kernel variant and of the selection routines
+void benchmark() {
+    constexpr size_t Size = 1 << 22;
+    constexpr int Rounds = 20;
 
-    for (int num : arr) {
-        minHeap.push(num);
-        if (minHeap.size() > n) {
-            minHeap.pop();  // Remove the smallest element to keep only n largest
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(-1'000'000, 1'000'000);
+    std::vector<int> data(Size);
+    std::generate(data.begin(), data.end(), [&] { return dist(gen); });
+    std::vector<int> less(Size + 16), greater(Size + 16);
+
+    auto perElement = [&](const char* name, auto&& f) {
+        volatile size_t sink = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (int round = 0; round < Rounds; ++round) {
+            sink = sink + f();
         }
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+        std::cout << "  " << name << ": " << ns / (double(Size) * Rounds) << " ns/element\n";
+    };
+
+    std::vector<const kernels::Dispatch*> variants{&kernels::scalar};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) variants.push_back(&kernels::avx2);
+    if (__builtin_cpu_supports("avx512f")) variants.push_back(&kernels::avx512);
+
+    for (auto* k : variants) {
+        std::cout << k->name << ":\n";
+        perElement("countGreater", [&] { return k->countGreater(data.data(), Size, 0); });
+        perElement("minMax      ", [&] { return size_t(k->minMax(data.data(), Size).max); });
+        perElement("partition   ", [&] { return k->partition(data.data(), Size, 0, less.data(), greater.data()).first; });
     }
 
-    // The n-th largest element is at the top of the min-heap
-    std::cout << "The " << n << "-th largest element is: " << minHeap.top() << std::endl;
+    std::cout << "selection (" << kernels::best().name << "):\n";
+    std::vector<int> scratch(scratchSize(Size));
+    perElement("nth_element      ", [&] { auto copy = data; nth_element(copy, Size / 2, scratch); return size_t(copy[Size / 2]); });
+    perElement("std::nth_element ", [&] {
+        auto copy = data;
+        std::nth_element(copy.begin(), copy.begin() + Size / 2, copy.end());
+        return size_t(copy[Size / 2]);
+    });
+    perElement("nthLargest(100)  ", [&] { return size_t(nthLargest(data, 100)); });
 }
 
-int main() {
+// ./findnthlargest bench also runs the kernel benchmark
+int main(int argc, char* argv[]) {
     std::vector<int> arr = {12, 5, 787, 1, 23};
-    size_t n = 3;
-    mostEffecient(arr, 3);
-    secondEffect(arr, 3);
+    int n = 3;
+    mostEffecient(arr, n);
+    secondEffect(arr, n);
 
+    if (argc > 1 && std::string_view(argv[1]) == "bench") {
+        benchmark();
+    }
     return 0;
 }
@@ -1,6 +1,8 @@
+#pragma once
+
 #include "utils/utils.h"
 
-enum class MatrixAction
+enum class MatrixAction : uint8_t
 {
     CONTINUE_CURRENT_REJECT_NEXT,  
     CONTINUE_CURRENT_HOLD_NEXT,
@@ -10,7 +12,8 @@ enum class MatrixAction
 std::ostream& operator<<(std::ostream& os, MatrixAction c);
 
 // WARNING: the order of element is on purpose to access array by index
-enum class Champion
+// one byte each so SoA arrays of codes can be processed 32/64 at a time
+enum class Champion : uint8_t
 {
     Garen,
     Teemo,
@@ -19,5 +22,7 @@ enum class Champion
     Nami,
     Yasuo,
     Nunu,
+    Count,      // not a champion: keep it last, new champions go above
 };
+constexpr size_t ChampionCount = static_cast<size_t>(Champion::Count);
 std::ostream& operator<<(std::ostream& os, Champion c);
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#include "common/matrixStore.h"
+#include "common/prioMatrix.h"
+
+namespace PrioMatrix
+{
+    namespace
+    {
+        std::optional<MatrixAction> fromSymbol(char symbol)
+        {
+            switch (symbol)
+            {
+                case 'o': return MatrixAction::CONTINUE_CURRENT_REJECT_NEXT;
+                case '^': return MatrixAction::CONTINUE_CURRENT_HOLD_NEXT;
+                case 'x': return MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT;
+                default:  return std::nullopt;
+            }
+        }
+
+        char toSymbol(MatrixAction action)
+        {
+            switch (action)
+            {
+                case MatrixAction::CONTINUE_CURRENT_REJECT_NEXT:    return 'o';
+                case MatrixAction::CONTINUE_CURRENT_HOLD_NEXT:      return '^';
+                case MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT:  return 'x';
+                default:                                            return '?';
+            }
+        }
+
+        std::runtime_error parseError(size_t line, const std::string& what)
+        {
+            return std::runtime_error(Utils::StringCreator::to_string("priority matrix line ", line, ": ", what));
+        }
+    }
+
+    RuntimeMatrix::RuntimeMatrix(std::vector<std::string> names, std::vector<MatrixAction> actions)
+        : m_count(names.size()), m_names(std::move(names)), m_actions(std::move(actions))
+    {
+    }
+
+    RuntimeMatrix RuntimeMatrix::parse(std::istream& in)
+    {
+        std::vector<std::string> names;
+        std::vector<MatrixAction> actions;
+        size_t rows = 0;
+        size_t lineNumber = 0;
+
+        std::string line;
+        while (std::getline(in, line))
+        {
+            ++lineNumber;
+            std::istringstream fields(line);
+            std::string first;
+            if (!(fields >> first) || first[0] == '#')
+            {
+                continue;
+            }
+
+            if (names.empty())
+            {
+                if (first != "champions")
+                {
+                    throw parseError(lineNumber, "expected 'champions' header");
+                }
+                for (std::string name; fields >> name;)
+                {
+                    if (std::find(names.begin(), names.end(), name) != names.end())
+                    {
+                        throw parseError(lineNumber, "duplicate champion " + name);
+                    }
+                    names.push_back(std::move(name));
+                }
+                if (names.empty() || names.size() > MaxChampions)
+                {
+                    throw parseError(lineNumber, Utils::StringCreator::to_string("expected 1 to ", MaxChampions, " champions"));
+                }
+                actions.reserve(names.size() * names.size());
+                continue;
+            }
+
+            if (rows == names.size())
+            {
+                throw parseError(lineNumber, "more rows than champions");
+            }
+            if (first != names[rows])
+            {
+                throw parseError(lineNumber, "expected row of " + names[rows] + ", got " + first);
+            }
+
+            size_t columns = 0;
+            for (char symbol; fields >> symbol; ++columns)
+            {
+                auto action = fromSymbol(symbol);
+                if (!action)
+                {
+                    throw parseError(lineNumber, std::string("unknown action '") + symbol + "'");
+                }
+                actions.push_back(*action);
+            }
+            if (columns != names.size())
+            {
+                throw parseError(lineNumber, Utils::StringCreator::to_string("expected ", names.size(), " actions, got ", columns));
+            }
+            ++rows;
+        }
+
+        if (names.empty() || rows != names.size())
+        {
+            throw parseError(lineNumber, Utils::StringCreator::to_string("expected ", names.size(), " rows, got ", rows));
+        }
+        return RuntimeMatrix(std::move(names), std::move(actions));
+    }
+
+    RuntimeMatrix RuntimeMatrix::load(const std::string& path)
+    {
+        std::ifstream in(path);
+        if (!in)
+        {
+            throw std::runtime_error("cannot open priority matrix " + path);
+        }
+        return parse(in);
+    }
+
+    RuntimeMatrix RuntimeMatrix::builtin()
+    {
+        std::vector<std::string> names;
+        std::vector<MatrixAction> actions;
+        for (const auto& row : Table)
+        {
+            names.push_back(Utils::StringCreator::to_string(row.current));
+            actions.insert(actions.end(), row.actions.begin(), row.actions.end());
+        }
+        return RuntimeMatrix(std::move(names), std::move(actions));
+    }
+
+    void RuntimeMatrix::checkBatch(std::span<const Champion> current, std::span<const Champion> next,
+                                   std::span<MatrixAction> out) const noexcept
+    {
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            out[i] = check(current[i], next[i]);
+        }
+    }
+
+    std::optional<Champion> RuntimeMatrix::find(std::string_view name) const noexcept
+    {
+        auto it = std::find(m_names.begin(), m_names.end(), name);
+        if (it == m_names.end())
+        {
+            return std::nullopt;
+        }
+        return static_cast<Champion>(it - m_names.begin());
+    }
+
+    void RuntimeMatrix::save(std::ostream& out) const
+    {
+        out << "champions";
+        for (const auto& name : m_names)
+        {
+            out << ' ' << name;
+        }
+        out << '\n';
+        for (size_t current = 0; current < m_count; ++current)
+        {
+            out << m_names[current];
+            for (size_t next = 0; next < m_count; ++next)
+            {
+                out << ' ' << toSymbol(m_actions[current * m_count + next]);
+            }
+            out << '\n';
+        }
+    }
+
+    MatrixStore::Reader::Reader(const MatrixStore& store)
+        : m_store(store), m_slot(nullptr)
+    {
+        // each slot is tried once, starting from the one this thread had last time
+        thread_local size_t preferred = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        auto epoch = store.m_epoch.load();
+        for (size_t i = preferred; i < preferred + MaxReaders; ++i)
+        {
+            auto& slot = store.m_readers[i % MaxReaders];
+            uint64_t idle = Idle;
+            if (slot.epoch.compare_exchange_strong(idle, epoch))
+            {
+                m_slot = &slot;
+                preferred = i;
+                break;
+            }
+        }
+        if (!m_slot)
+        {
+            // all slots busy: seq_cst, reclaim() sees the count or this loads the new matrix
+            store.m_overflow.fetch_add(1);
+        }
+        m_matrix = store.m_current.load();
+    }
+
+    MatrixStore::Reader::~Reader()
+    {
+        if (m_slot)
+        {
+            m_slot->epoch.store(Idle, std::memory_order_release);
+        }
+        else
+        {
+            m_store.m_overflow.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    MatrixStore::MatrixStore(RuntimeMatrix initial)
+        : m_current(new RuntimeMatrix(std::move(initial)))
+    {
+    }
+
+    MatrixStore::~MatrixStore()
+    {
+        delete m_current.load();
+    }
+
+    void MatrixStore::publish(RuntimeMatrix matrix)
+    {
+        auto next = std::make_unique<const RuntimeMatrix>(std::move(matrix));
+
+        std::lock_guard lock(m_publisher);
+        std::unique_ptr<const RuntimeMatrix> previous(m_current.exchange(next.release()));
+        m_retired.emplace_back(m_epoch.fetch_add(1), std::move(previous));
+        m_version.fetch_add(1, std::memory_order_relaxed);
+        reclaim();
+    }
+
+    void MatrixStore::reclaim()
+    {
+        if (m_overflow.load() != 0)
+        {
+            return; // a reader without a slot may hold any retired matrix
+        }
+
+        uint64_t oldest = Idle;
+        for (auto& slot : m_readers)
+        {
+            oldest = std::min(oldest, slot.epoch.load());
+        }
+
+        // a reader that may still hold a matrix announced an epoch <= its retire epoch
+        auto it = m_retired.begin();
+        while (it != m_retired.end() && it->first < oldest)
+        {
+            ++it;
+        }
+        m_retired.erase(m_retired.begin(), it);
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/definition.h"
+
+namespace PrioMatrix
+{
+    // Priority matrix loaded at runtime: any number of champions up to MaxChampions,
+    // flat row-major table of one MatrixAction per (current, next) pair.
+    // Champion codes index the table, names only exist for the file and the logs.
+    //
+    // File format, one row per current champion in the order of the header:
+    //   # comment
+    //   champions Garen Teemo Caitlyn
+    //   Garen   ^ ^ x
+    //   Teemo   o o x
+    //   Caitlyn o ^ o
+    // where o = CONTINUE_CURRENT_REJECT_NEXT, ^ = CONTINUE_CURRENT_HOLD_NEXT,
+    // x = TERMINATE_CURRENT_EXECUTE_NEXT. Blanks between symbols are optional.
+    class RuntimeMatrix
+    {
+    public:
+        // codes are one byte, the last one is kept out of range for NODEF
+        static constexpr size_t MaxChampions = 255;
+
+        // throw std::runtime_error with the line number on malformed input
+        static RuntimeMatrix parse(std::istream& in);
+        static RuntimeMatrix load(const std::string& path);
+
+        // the compiled-in matrix of prioMatrix.h
+        static RuntimeMatrix builtin();
+
+        // NODEF for codes out of range, as checkPrioMatrix
+        MatrixAction check(Champion current, Champion next) const noexcept
+        {
+            auto c = Utils::to_underlying(current);
+            auto n = Utils::to_underlying(next);
+            if (c >= m_count || n >= m_count)
+            {
+                return MatrixAction::NODEF;
+            }
+            return m_actions[c * m_count + n];
+        }
+
+        void checkBatch(std::span<const Champion> current, std::span<const Champion> next,
+                        std::span<MatrixAction> out) const noexcept;
+
+        size_t size() const noexcept { return m_count; }
+        const std::string& name(Champion c) const { return m_names.at(Utils::to_underlying(c)); }
+        std::optional<Champion> find(std::string_view name) const noexcept;
+
+        void save(std::ostream& out) const;
+
+    private:
+        RuntimeMatrix(std::vector<std::string> names, std::vector<MatrixAction> actions);
+
+        size_t m_count;
+        std::vector<std::string> m_names;
+        std::vector<MatrixAction> m_actions;
+    };
+
+    // Current matrix shared by the arbitration threads, replaced as a whole by
+    // publish(): RCU-style, readers load the pointer after announcing the epoch they
+    // start in and never lock; the publisher frees a replaced matrix once every
+    // announced epoch is newer than the one it was retired in.
+    // Readers beyond MaxReaders at once are counted in m_overflow instead of a slot;
+    // nothing is freed while any is alive.
+    // Reclamation only runs in publish(): a matrix still read when it was replaced
+    // stays allocated until the next publish() or the store's destruction.
+    class MatrixStore
+    {
+        static constexpr size_t MaxReaders = 64;
+        static constexpr uint64_t Idle = UINT64_MAX;
+
+        struct alignas(64) ReaderSlot
+        {
+            std::atomic<uint64_t> epoch{Idle};
+        };
+
+    public:
+        // Pins the matrix it was created on until destroyed, keep it short-lived:
+        // one per arbitration batch, not per thread.
+        class Reader
+        {
+        public:
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+            ~Reader();
+
+            const RuntimeMatrix& operator*() const noexcept { return *m_matrix; }
+            const RuntimeMatrix* operator->() const noexcept { return m_matrix; }
+
+        private:
+            friend class MatrixStore;
+            explicit Reader(const MatrixStore& store);
+
+            const MatrixStore& m_store;
+            ReaderSlot* m_slot;     // nullptr when counted in m_overflow
+            const RuntimeMatrix* m_matrix;
+        };
+
+        explicit MatrixStore(RuntimeMatrix initial);
+        ~MatrixStore();
+        MatrixStore(const MatrixStore&) = delete;
+        MatrixStore& operator=(const MatrixStore&) = delete;
+
+        Reader read() const { return Reader(*this); }
+
+        // single lookup, pins the current matrix for its duration only
+        MatrixAction check(Champion current, Champion next) const noexcept
+        {
+            return read()->check(current, next);
+        }
+
+        // swaps in a new matrix, arbitrations already running finish on the old one
+        void publish(RuntimeMatrix matrix);
+
+        // loads then publishes: a malformed file throws and keeps the current matrix
+        void reload(const std::string& path) { publish(RuntimeMatrix::load(path)); }
+
+        // number of publish() since construction
+        uint64_t version() const noexcept { return m_version.load(std::memory_order_relaxed); }
+
+    private:
+        void reclaim();
+
+        std::atomic<const RuntimeMatrix*> m_current;
+        std::atomic<uint64_t> m_epoch{0};
+        std::atomic<uint64_t> m_version{0};
+        mutable std::array<ReaderSlot, MaxReaders> m_readers;
+        mutable std::atomic<size_t> m_overflow{0};
+
+        // publisher state
+        std::mutex m_publisher;
+        std::vector<std::pair<uint64_t, std::unique_ptr<const RuntimeMatrix>>> m_retired; // (epoch, old matrix)
+    };
+}
@@ -0,0 +1,104 @@
+#include <immintrin.h>
+
+#include "common/prioMatrix.h"
+
+namespace
+{
+    using Kernel = void (*)(const Champion*, const Champion*, MatrixAction*, size_t);
+
+    void batchScalar(const Champion* current, const Champion* next, MatrixAction* out, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            out[i] = checkPrioMatrix(current[i], next[i]);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void batchAvx2(const Champion* current, const Champion* next, MatrixAction* out, size_t size)
+    {
+        // pshufb looks up 16 bytes per 128-bit lane: one broadcast slice per 16 table entries
+        __m256i slices[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            slices[k] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(PrioMatrix::Flat.data() + 16 * k)));
+        }
+        const auto maxCode = _mm256_set1_epi8(ChampionCount - 1);
+        const auto low3 = _mm256_set1_epi8(0x07);
+        const auto low4 = _mm256_set1_epi8(0x0f);
+        const auto high = _mm256_set1_epi8(static_cast<char>(0xf8));
+        const auto nodef = _mm256_set1_epi8(Utils::to_underlying(MatrixAction::NODEF));
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + i));
+            auto n = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(next + i));
+
+            // index = c * 7 + n = (c << 3) - c + n, only meaningful for valid codes
+            static_assert(ChampionCount == 7, "the AVX2 index is c * 7 + n, by shift and subtract");
+            auto c8 = _mm256_and_si256(_mm256_slli_epi16(c, 3), high);
+            auto index = _mm256_add_epi8(_mm256_sub_epi8(c8, c), n);
+            auto slice = _mm256_and_si256(_mm256_srli_epi16(index, 4), low3);
+            auto inSlice = _mm256_and_si256(index, low4);
+
+            auto result = nodef;
+            for (int k = 0; k < 4; ++k)
+            {
+                auto selected = _mm256_cmpeq_epi8(slice, _mm256_set1_epi8(static_cast<char>(k)));
+                result = _mm256_blendv_epi8(result, _mm256_shuffle_epi8(slices[k], inSlice), selected);
+            }
+
+            // codes >= ChampionCount give NODEF, like checkPrioMatrix
+            auto valid = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(c, maxCode), maxCode),
+                                          _mm256_cmpeq_epi8(_mm256_max_epu8(n, maxCode), maxCode));
+            result = _mm256_blendv_epi8(nodef, result, valid);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+        }
+        batchScalar(current + i, next + i, out + i, size - i);
+    }
+
+    __attribute__((target("avx512f,avx512bw,avx512vbmi")))
+    void batchAvx512(const Champion* current, const Champion* next, MatrixAction* out, size_t size)
+    {
+        const auto table = _mm512_load_si512(PrioMatrix::Flat.data());
+        const auto maxCode = _mm512_set1_epi8(ChampionCount - 1);
+        const auto count = _mm512_set1_epi16(ChampionCount);
+        const auto nodef = _mm512_set1_epi8(Utils::to_underlying(MatrixAction::NODEF));
+        const auto evenBytes = _mm512_set1_epi16(0x00ff);
+
+        size_t i = 0;
+        for (; i + 64 <= size; i += 64)
+        {
+            auto c = _mm512_loadu_si512(current + i);
+            auto n = _mm512_loadu_si512(next + i);
+
+            // c * ChampionCount per byte: multiply even and odd bytes as 16-bit lanes
+            auto even = _mm512_mullo_epi16(_mm512_and_si512(c, evenBytes), count);
+            auto odd = _mm512_mullo_epi16(_mm512_srli_epi16(c, 8), count);
+            auto row = _mm512_or_si512(_mm512_and_si512(even, evenBytes), _mm512_slli_epi16(odd, 8));
+            auto index = _mm512_add_epi8(row, n);
+
+            // lookup on the low 6 bits of index, merged into NODEF for invalid codes;
+            // the merge form also avoids the undefined source of the unmasked one
+            auto valid = _mm512_cmple_epu8_mask(c, maxCode) & _mm512_cmple_epu8_mask(n, maxCode);
+            _mm512_storeu_si512(out + i, _mm512_mask_permutexvar_epi8(nodef, valid, index, table));
+        }
+        batchAvx2(current + i, next + i, out + i, size - i);
+    }
+
+    Kernel selectKernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw")) return batchAvx512;
+        if (__builtin_cpu_supports("avx2")) return batchAvx2;
+        return batchScalar;
+    }
+}
+
+void checkPrioMatrixBatch(std::span<const Champion> current, std::span<const Champion> next,
+                          std::span<MatrixAction> out) noexcept
+{
+    static const Kernel kernel = selectKernel();
+    kernel(current.data(), next.data(), out.data(), out.size());
+}
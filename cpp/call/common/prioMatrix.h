@@ -0,0 +1,122 @@
+#pragma once
+
+#include <span>
+
+#include "common/definition.h"
+
+// Priority matrix as a compile-time table: 2 bits per MatrixAction, one uint16_t
+// row per current champion, so a lookup is one load, one shift and one mask.
+namespace PrioMatrix
+{
+    constexpr auto WHITE_CIRCLE  = MatrixAction::CONTINUE_CURRENT_REJECT_NEXT;
+    constexpr auto DELTA         = MatrixAction::CONTINUE_CURRENT_HOLD_NEXT;
+    constexpr auto BLACK_CIRCLE  = MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT;
+
+    using PackedRow = uint16_t;
+    constexpr size_t BitsPerAction = 2;
+    static_assert(Utils::to_underlying(MatrixAction::NODEF) < (1 << BitsPerAction), "MatrixAction does not fit in 2 bits");
+    static_assert(ChampionCount * BitsPerAction <= sizeof(PackedRow) * 8, "row does not fit in PackedRow");
+
+    struct Row
+    {
+        Champion current;
+        std::array<MatrixAction, ChampionCount> actions;
+    };
+
+    // a row must list an action for every next champion
+    template <typename... Actions>
+        requires (sizeof...(Actions) == ChampionCount && (std::is_same_v<Actions, MatrixAction> && ...))
+    consteval Row row(Champion current, Actions... actions)
+    {
+        return {current, {actions...}};
+    }
+
+    constexpr std::array<Row, ChampionCount> Table
+    {
+        //        next ->
+        // current
+        // |
+        // v                Garen           Teemo           Caitlyn         Blitz           Nami            Yasuo           Nunu
+        row(Champion::Garen,   DELTA,         DELTA,          DELTA,          BLACK_CIRCLE,   DELTA,          BLACK_CIRCLE,   BLACK_CIRCLE),
+        row(Champion::Teemo,   WHITE_CIRCLE,  WHITE_CIRCLE,   WHITE_CIRCLE,   BLACK_CIRCLE,   WHITE_CIRCLE,   BLACK_CIRCLE,   BLACK_CIRCLE),
+        row(Champion::Caitlyn, WHITE_CIRCLE,  DELTA,          WHITE_CIRCLE,   BLACK_CIRCLE,   DELTA,          BLACK_CIRCLE,   BLACK_CIRCLE),
+        row(Champion::Blitz,   WHITE_CIRCLE,  WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   BLACK_CIRCLE),
+        row(Champion::Nami,    WHITE_CIRCLE,  WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   BLACK_CIRCLE),
+        row(Champion::Yasuo,   WHITE_CIRCLE,  WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   BLACK_CIRCLE),
+        row(Champion::Nunu,    WHITE_CIRCLE,  WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE,   WHITE_CIRCLE),
+    };
+
+    // every current champion has its row, in enum order, and no pair is NODEF
+    consteval bool isComplete()
+    {
+        for (size_t current = 0; current < ChampionCount; ++current)
+        {
+            if (Utils::to_underlying(Table[current].current) != static_cast<int>(current)) return false;
+            for (auto action : Table[current].actions)
+            {
+                if (action == MatrixAction::NODEF) return false;
+            }
+        }
+        return true;
+    }
+    static_assert(isComplete(), "priority matrix must define every (current, next) pair");
+
+    consteval std::array<PackedRow, ChampionCount> pack()
+    {
+        std::array<PackedRow, ChampionCount> packed{};
+        for (size_t current = 0; current < ChampionCount; ++current)
+        {
+            for (size_t next = 0; next < ChampionCount; ++next)
+            {
+                auto action = static_cast<PackedRow>(Utils::to_underlying(Table[current].actions[next]));
+                packed[current] |= static_cast<PackedRow>(action << (next * BitsPerAction));
+            }
+        }
+        return packed;
+    }
+
+    constexpr std::array<PackedRow, ChampionCount> Packed = pack();
+
+    // byte per pair at [current * ChampionCount + next], the rest NODEF:
+    // the 64-byte source of the shuffle/permute lookups of checkPrioMatrixBatch
+    constexpr size_t FlatSize = 64;
+    static_assert(ChampionCount * ChampionCount <= FlatSize, "matrix does not fit one 64-byte permute");
+
+    consteval std::array<uint8_t, FlatSize> flatten()
+    {
+        std::array<uint8_t, FlatSize> flat{};
+        flat.fill(Utils::to_underlying(MatrixAction::NODEF));
+        for (size_t current = 0; current < ChampionCount; ++current)
+        {
+            for (size_t next = 0; next < ChampionCount; ++next)
+            {
+                flat[current * ChampionCount + next] = Utils::to_underlying(Table[current].actions[next]);
+            }
+        }
+        return flat;
+    }
+
+    alignas(64) constexpr std::array<uint8_t, FlatSize> Flat = flatten();
+}
+
+constexpr MatrixAction checkPrioMatrix(Champion current, Champion next) noexcept
+{
+    auto c = static_cast<size_t>(Utils::to_underlying(current));
+    auto n = static_cast<size_t>(Utils::to_underlying(next));
+    if (c >= ChampionCount || n >= ChampionCount)
+    {
+        return MatrixAction::NODEF;
+    }
+
+    return static_cast<MatrixAction>((PrioMatrix::Packed[c] >> (n * PrioMatrix::BitsPerAction)) & 0b11);
+}
+
+static_assert(checkPrioMatrix(Champion::Teemo, Champion::Caitlyn) == MatrixAction::CONTINUE_CURRENT_REJECT_NEXT);
+static_assert(checkPrioMatrix(Champion::Garen, Champion::Blitz) == MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT);
+
+// Batch arbitration over SoA inputs: out[i] = checkPrioMatrix(current[i], next[i])
+// for i < out.size(); current and next must hold at least out.size() codes.
+// Uses AVX-512 VBMI (one byte permute over the whole table) or AVX2 (four pshufb
+// over 16-byte slices), picked at runtime, with a scalar fallback.
+void checkPrioMatrixBatch(std::span<const Champion> current, std::span<const Champion> next,
+                          std::span<MatrixAction> out) noexcept;
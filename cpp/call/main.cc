@@ -1,6 +1,18 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <utility>
+
 #include "common/definition.h"
+#include "common/matrixStore.h"
+#include "common/prioMatrix.h"
+#include "state/sessionStore.h"
+#include "state/stateMachine.h"
 
-MatrixAction checkPrioMatrix(Champion current, Champion next) noexcept
+// previous implementation, kept as the baseline of the benchmark
+MatrixAction checkPrioMatrixMap(Champion current, Champion next) noexcept
 {
     auto WHITE_CIRCLE  = MatrixAction::CONTINUE_CURRENT_REJECT_NEXT;
     auto DELTA         = MatrixAction::CONTINUE_CURRENT_HOLD_NEXT;
@@ -8,10 +20,6 @@ MatrixAction checkPrioMatrix(Champion current, Champion next) noexcept
 
     const std::map<Champion, std::array<MatrixAction, 7>> prioMatrix
     {
-        //        next ->
-        // current
-        // |
-        // v                Garen           Teemo           Caitlyn         Blitz           Nami            Yasuo           Nunu
         {Champion::Garen,   {DELTA,         DELTA,          DELTA,          BLACK_CIRCLE,   DELTA,          BLACK_CIRCLE,   BLACK_CIRCLE}},
         {Champion::Teemo,   {WHITE_CIRCLE,  WHITE_CIRCLE,   WHITE_CIRCLE,   BLACK_CIRCLE,   WHITE_CIRCLE,   BLACK_CIRCLE,   BLACK_CIRCLE}},
         {Champion::Caitlyn, {WHITE_CIRCLE,  DELTA,          WHITE_CIRCLE,   BLACK_CIRCLE,   DELTA,          BLACK_CIRCLE,   BLACK_CIRCLE}},
@@ -35,15 +43,593 @@ MatrixAction checkPrioMatrix(Champion current, Champion next) noexcept
     {
         std::cout << ex.what() << '\n';
     }
-    catch (const std::runtime_error& ex)
+    return MatrixAction::NODEF;
+}
+
+template <typename Func>
+void benchmark(std::string_view description, Func&& check,
+               const std::vector<Champion>& current, const std::vector<Champion>& next)
+{
+    size_t counts[4]{};
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < current.size(); ++i)
     {
-        std::cout << ex.what() << '\n';
+        ++counts[Utils::to_underlying(check(current[i], next[i]))];
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    auto ns = std::chrono::duration<double, std::nano>(end - begin).count() / current.size();
+    std::cout << description << ": " << ns << " ns/call (hold " << counts[1] << ")\n";
+}
+
+void benchmarkPrioMatrix()
+{
+    constexpr size_t Calls = 2'000'000;
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> champion(0, ChampionCount - 1);
+    std::vector<Champion> current(Calls), next(Calls);
+    for (size_t i = 0; i < Calls; ++i)
+    {
+        current[i] = static_cast<Champion>(champion(gen));
+        next[i] = static_cast<Champion>(champion(gen));
+    }
+
+    benchmark("std::map matrix   ", checkPrioMatrixMap, current, next);
+    benchmark("packed constexpr  ", checkPrioMatrix, current, next);
+
+    constexpr int Rounds = 20;
+    std::vector<MatrixAction> actions(Calls);
+    auto begin = std::chrono::steady_clock::now();
+    for (int round = 0; round < Rounds; ++round)
+    {
+        checkPrioMatrixBatch(current, next, actions);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    auto seconds = std::chrono::duration<double>(end - begin).count();
+    auto hold = std::count(actions.begin(), actions.end(), MatrixAction::CONTINUE_CURRENT_HOLD_NEXT);
+    std::cout << "batch SoA         : " << seconds * 1e9 / (Calls * Rounds) << " ns/call, "
+              << Calls * Rounds / seconds / 1e6 << " M decisions/s (hold " << hold << ")\n";
+
+    // runtime matrix while another thread keeps publishing new versions
+    PrioMatrix::MatrixStore store(PrioMatrix::RuntimeMatrix::builtin());
+    std::atomic<bool> done{false};
+    std::thread publisher([&]
+    {
+        while (!done.load(std::memory_order_relaxed))
+        {
+            store.publish(PrioMatrix::RuntimeMatrix::builtin());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    constexpr size_t Batch = 1024;
+    begin = std::chrono::steady_clock::now();
+    for (int round = 0; round < Rounds; ++round)
+    {
+        for (size_t i = 0; i < Calls; i += Batch)
+        {
+            auto size = std::min(Batch, Calls - i);
+            auto matrix = store.read();
+            matrix->checkBatch(std::span(current).subspan(i, size), std::span(next).subspan(i, size),
+                               std::span(actions).subspan(i, size));
+        }
+    }
+    end = std::chrono::steady_clock::now();
+    done = true;
+    publisher.join();
+
+    seconds = std::chrono::duration<double>(end - begin).count();
+    hold = std::count(actions.begin(), actions.end(), MatrixAction::CONTINUE_CURRENT_HOLD_NEXT);
+    std::cout << "runtime matrix    : " << seconds * 1e9 / (Calls * Rounds) << " ns/call with "
+              << store.version() << " reloads (hold " << hold << ")\n";
+}
+
+void benchmarkSessions()
+{
+    constexpr size_t SessionCount = 1'000'000;
+    constexpr size_t Events = 20'000'000;
+
+    // random events on random sessions, mostly incoming calls so the matrix decides
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<uint32_t> session(0, SessionCount - 1);
+    std::uniform_int_distribution<int> champion(0, ChampionCount - 1);
+    std::discrete_distribution<int> event({6, 3, 1});
+    std::vector<uint32_t> sessions(Events);
+    std::vector<CallState::Event> events(Events);
+    std::vector<Champion> champions(Events);
+    for (size_t i = 0; i < Events; ++i)
+    {
+        sessions[i] = session(gen);
+        events[i] = static_cast<CallState::Event>(event(gen));
+        champions[i] = static_cast<Champion>(champion(gen));
+    }
+
+    PrioMatrix::MatrixStore matrix(PrioMatrix::RuntimeMatrix::builtin());
+    CallState::Sessions machine(SessionCount, matrix);
+    std::vector<CallState::Effect> effects(Events);
+    auto begin = std::chrono::steady_clock::now();
+    machine.dispatchBatch(sessions, events, champions, effects);
+    auto end = std::chrono::steady_clock::now();
+
+    size_t counts[8]{};
+    for (auto effect : effects)
+    {
+        ++counts[Utils::to_underlying(effect)];
+    }
+    auto seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "session machine   : " << Events / seconds / 1e6 << " M events/s over " << SessionCount
+              << " sessions (preempt " << counts[Utils::to_underlying(CallState::Effect::Preempt)]
+              << ", hold " << counts[Utils::to_underlying(CallState::Effect::Hold)] << ")\n";
+}
+
+// the builtin matrix and two champions the enum does not know, codes 7 and 8
+constexpr const char* WiderMatrix =
+    "# two more champions\n"
+    "champions Garen Teemo Caitlyn Blitz Nami Yasuo Nunu Ahri Zed\n"
+    "Garen   ^^^x^xx ^x\n"
+    "Teemo   oooxoxx ox\n"
+    "Caitlyn o^oxoxx ox\n"
+    "Blitz   oooooox oo\n"
+    "Nami    oooooox oo\n"
+    "Yasuo   oooooox oo\n"
+    "Nunu    ooooooo oo\n"
+    "Ahri    xxxxxxx o^\n"
+    "Zed     ooooooo xo\n";
+
+// Random traffic on the lines first, first + stride, ... with the effects the store
+// must report, replayed on CallState::Sessions: an Incoming places a new call,
+// Release and Cancel name the line's current or held call, one in eight a stale one.
+struct LineTraffic
+{
+    std::vector<CallState::LineId> lines;
+    std::vector<CallState::CallId> calls;
+    std::vector<CallState::Event> events;
+    std::vector<Champion> champions;
+    std::vector<CallState::Effect> effects;     // expected
+};
+
+class LineModel
+{
+public:
+    LineModel(size_t lineCount, CallState::LineId first, CallState::LineId stride, uint64_t seed,
+              const PrioMatrix::MatrixStore& matrix)
+        : m_sessions(lineCount, matrix), m_currentCall(lineCount), m_heldCall(lineCount)
+        , m_first(first), m_stride(stride), m_gen(seed)
+    {
+    }
+
+    void generate(size_t count, LineTraffic& traffic)
+    {
+        using CallState::Effect;
+        using CallState::Event;
+        std::uniform_int_distribution<size_t> line(0, m_sessions.size() - 1);
+        std::uniform_int_distribution<int> champion(0, ChampionCount - 1);
+        std::discrete_distribution<int> event({6, 3, 1});
+        traffic.lines.resize(count);
+        traffic.calls.resize(count);
+        traffic.events.resize(count);
+        traffic.champions.resize(count);
+        traffic.effects.resize(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto l = line(m_gen);
+            auto e = static_cast<Event>(event(m_gen));
+            auto c = static_cast<Champion>(champion(m_gen));
+            CallState::CallId placed = e == Event::Release ? m_currentCall[l] : e == Event::Cancel ? m_heldCall[l] : 0;
+            CallState::CallId call = placed != 0 && m_gen() % 8 != 0 ? placed : m_nextCall++;
+            auto effect = e == Event::Incoming || call == placed ? m_sessions.dispatch(l, e, c) : Effect::Ignore;
+            switch (effect)
+            {
+                case Effect::Accept:
+                case Effect::Preempt:   m_currentCall[l] = call;                        break;
+                case Effect::Hold:      m_heldCall[l] = call;                           break;
+                case Effect::Resume:    m_currentCall[l] = std::exchange(m_heldCall[l], 0); break;
+                case Effect::End:       m_currentCall[l] = 0;                           break;
+                case Effect::Drop:      m_heldCall[l] = 0;                              break;
+                default:                                                                break;
+            }
+            traffic.lines[i] = m_first + l * m_stride;
+            traffic.calls[i] = call;
+            traffic.events[i] = e;
+            traffic.champions[i] = c;
+            traffic.effects[i] = effect;
+        }
+    }
+
+    // the store holds exactly the busy lines of the model
+    bool matches(const CallState::SessionStore& store) const
+    {
+        size_t busy = 0;
+        for (size_t l = 0; l < m_sessions.size(); ++l)
+        {
+            auto found = store.find(m_first + l * m_stride);
+            if (m_sessions.state(l) == CallState::State::Idle)
+            {
+                if (found) return false;
+                continue;
+            }
+            ++busy;
+            if (!found || found->state != m_sessions.state(l) || found->current != m_sessions.current(l)
+                || found->held != m_sessions.held(l) || found->currentCall != m_currentCall[l]
+                || found->heldCall != m_heldCall[l])
+            {
+                return false;
+            }
+        }
+        return store.size() == busy;
+    }
+
+private:
+    CallState::Sessions m_sessions;
+    std::vector<CallState::CallId> m_currentCall;   // 0 when there is none
+    std::vector<CallState::CallId> m_heldCall;
+    CallState::LineId m_first;
+    CallState::LineId m_stride;
+    CallState::CallId m_nextCall = 1;
+    std::mt19937_64 m_gen;
+};
+
+void benchmarkSessionStore()
+{
+    constexpr size_t LiveLines = 200'000;
+    constexpr size_t Events = 4'194'304;
+    constexpr size_t Batch = 4096;
+    constexpr size_t Threads = 4;
+
+    // each thread owns its lines so the arbitrations do not depend on interleaving
+    PrioMatrix::MatrixStore matrix(PrioMatrix::RuntimeMatrix::builtin());
+    std::vector<LineTraffic> traffic(Threads);
+    for (size_t t = 0; t < Threads; ++t)
+    {
+        LineModel(LiveLines, t + 1, Threads, t, matrix).generate(Events, traffic[t]);
+    }
+
+    auto run = [&](CallState::SessionStore& store, size_t threads)
+    {
+        std::vector<std::thread> workers;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&store, &events = traffic[t]]
+            {
+                std::vector<CallState::Effect> effects(Batch);
+                for (size_t i = 0; i < Events; i += Batch)
+                {
+                    store.dispatchBatch(std::span(events.lines).subspan(i, Batch), std::span(events.calls).subspan(i, Batch),
+                                        std::span(events.events).subspan(i, Batch),
+                                        std::span(events.champions).subspan(i, Batch), effects);
+                }
+            });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(end - begin).count();
+    };
+
+    static_assert(Events % Batch == 0);
+    for (size_t threads : {size_t{1}, Threads})
+    {
+        CallState::SessionStore store(matrix, LiveLines * threads);
+        auto seconds = run(store, threads);
+        std::cout << "session store     : " << Events * threads / seconds / 1e6 << " M events/s, "
+                  << threads << " thread(s), " << store.size() << " busy lines\n";
+    }
+}
+
+bool verifySessionStore()
+{
+    using CallState::Event;
+    using CallState::Effect;
+    using CallState::State;
+    constexpr auto None = CallState::NoCall;
+
+    // one batch over two interleaved lines, effects written by hand: a new call is
+    // arbitrated against the current call of its line, whichever call placed it
+    struct Step
+    {
+        CallState::LineId line;
+        CallState::CallId call;
+        Event event;
+        Champion champion;
+        Effect effect;
+    };
+    const Step steps[]
+    {
+        {1, 101, Event::Incoming, Champion::Garen,   Effect::Accept},
+        {2, 201, Event::Incoming, Champion::Teemo,   Effect::Accept},
+        {1, 102, Event::Incoming, Champion::Teemo,   Effect::Hold},     // behind Garen
+        {2, 202, Event::Incoming, Champion::Caitlyn, Effect::Reject},   // Teemo keeps the line
+        {1, 103, Event::Incoming, Champion::Caitlyn, Effect::Reject},   // held slot taken
+        {1, 101, Event::Incoming, Champion::Nunu,    Effect::Ignore},   // already on the line
+        {2, 203, Event::Incoming, Champion::Blitz,   Effect::Preempt},  // call 201 terminated
+        {2, 201, Event::Release,  None,              Effect::Ignore},
+        {1, 104, Event::Incoming, Champion::Yasuo,   Effect::Preempt},  // call 101 terminated, 102 still held
+        {1, 102, Event::Release,  None,              Effect::Ignore},   // held, not current
+        {1, 104, Event::Release,  None,              Effect::Resume},   // 102 takes the line
+        {2, 203, Event::Cancel,   None,              Effect::Ignore},
+        {2, 203, Event::Release,  None,              Effect::End},
+        {3, 301, Event::Incoming, None,              Effect::Ignore},
+        {4, 401, Event::Release,  None,              Effect::Ignore},
+        {1, 105, Event::Incoming, Champion::Nami,    Effect::Reject},   // against Teemo now
+    };
+    std::vector<CallState::LineId> lines;
+    std::vector<CallState::CallId> calls;
+    std::vector<Event> events;
+    std::vector<Champion> champions;
+    for (const auto& step : steps)
+    {
+        lines.push_back(step.line);
+        calls.push_back(step.call);
+        events.push_back(step.event);
+        champions.push_back(step.champion);
+    }
+    std::vector<Effect> effects(calls.size());
+
+    PrioMatrix::MatrixStore matrix(PrioMatrix::RuntimeMatrix::builtin());
+    CallState::SessionStore scripted(matrix, 16, 4);
+    scripted.dispatchBatch(lines, calls, events, champions, effects);
+    for (size_t i = 0; i < calls.size(); ++i)
+    {
+        if (effects[i] != steps[i].effect)
+        {
+            std::cout << "session store mismatch on line " << lines[i] << " call " << calls[i] << ": "
+                      << effects[i] << " vs " << steps[i].effect << "\n";
+            return false;
+        }
+    }
+    auto one = scripted.find(1);
+    if (scripted.size() != 1 || !one || one->state != State::Active || one->current != Champion::Teemo
+        || one->currentCall != 102 || one->held != None || one->heldCall != 0
+        || scripted.find(2) || scripted.find(3) || scripted.find(4))
+    {
+        std::cout << "session store content mismatch after the scripted batch\n";
+        return false;
+    }
+
+    // random traffic on small tables so that growth and backward-shift erase are
+    // exercised, against the same lines replayed on CallState::Sessions
+    CallState::SessionStore store(matrix, 16, 4);
+    LineModel model(2000, 1, 1, 3, matrix);
+    LineTraffic traffic;
+    effects.resize(1000);
+    for (int round = 0; round < 200; ++round)
+    {
+        model.generate(1000, traffic);
+        store.dispatchBatch(traffic.lines, traffic.calls, traffic.events, traffic.champions, effects);
+        for (size_t i = 0; i < traffic.lines.size(); ++i)
+        {
+            if (effects[i] != traffic.effects[i])
+            {
+                std::cout << "session store mismatch on line " << traffic.lines[i] << ": " << effects[i]
+                          << " vs " << traffic.effects[i] << "\n";
+                return false;
+            }
+        }
+    }
+    if (!model.matches(store))
+    {
+        std::cout << "session store content mismatch after random traffic\n";
+        return false;
+    }
+    return true;
+}
+
+bool verifySessions()
+{
+    using CallState::Event;
+    using CallState::Effect;
+    using CallState::State;
+
+    struct Step
+    {
+        Event event;
+        Champion champion;
+        Effect effect;
+        State state;
+        Champion current;
+        Champion held;
+    };
+    constexpr auto None = CallState::NoCall;
+    const Step steps[]
+    {
+        {Event::Release,  None,              Effect::Ignore,  State::Idle,    None,              None},
+        {Event::Incoming, None,              Effect::Ignore,  State::Idle,    None,              None},
+        {Event::Incoming, Champion::Garen,   Effect::Accept,  State::Active,  Champion::Garen,   None},
+        {Event::Incoming, Champion::Teemo,   Effect::Hold,    State::Holding, Champion::Garen,   Champion::Teemo},
+        {Event::Incoming, Champion::Caitlyn, Effect::Reject,  State::Holding, Champion::Garen,   Champion::Teemo},
+        {Event::Incoming, None,              Effect::Ignore,  State::Holding, Champion::Garen,   Champion::Teemo},
+        {Event::Incoming, Champion::Blitz,   Effect::Preempt, State::Holding, Champion::Blitz,   Champion::Teemo},
+        {Event::Release,  None,              Effect::Resume,  State::Active,  Champion::Teemo,   None},
+        {Event::Incoming, Champion::Nami,    Effect::Reject,  State::Active,  Champion::Teemo,   None},
+        {Event::Cancel,   None,              Effect::Ignore,  State::Active,  Champion::Teemo,   None},
+        {Event::Incoming, Champion::Nunu,    Effect::Preempt, State::Active,  Champion::Nunu,    None},
+        {Event::Release,  None,              Effect::End,     State::Idle,    None,              None},
+    };
+
+    PrioMatrix::MatrixStore matrix(PrioMatrix::RuntimeMatrix::builtin());
+    CallState::Sessions sessions(2, matrix);
+    for (const auto& step : steps)
+    {
+        auto effect = sessions.dispatch(1, step.event, step.champion);
+        if (effect != step.effect || sessions.state(1) != step.state
+            || sessions.current(1) != step.current || sessions.held(1) != step.held)
+        {
+            std::cout << "session mismatch on " << step.event << ": " << effect << " -> " << sessions.state(1) << "\n";
+            return false;
+        }
+    }
+
+    // a reload applies to the next event: Ahri is unknown until the wider matrix
+    // is published, then takes the line and holds Zed behind it
+    auto ahri = static_cast<Champion>(7), zed = static_cast<Champion>(8);
+    bool unknown = sessions.dispatch(0, Event::Incoming, ahri) == Effect::Ignore;
+    std::istringstream wider(WiderMatrix);
+    matrix.publish(PrioMatrix::RuntimeMatrix::parse(wider));
+    if (!unknown || sessions.dispatch(0, Event::Incoming, ahri) != Effect::Accept
+        || sessions.dispatch(0, Event::Incoming, zed) != Effect::Hold
+        || sessions.state(0) != State::Holding || sessions.current(0) != ahri || sessions.held(0) != zed)
+    {
+        std::cout << "sessions ignore the reloaded matrix\n";
+        return false;
+    }
+    return true;
+}
+
+bool verifyBatch()
+{
+    // every code pair including out of range ones, with a tail not multiple of the vector width
+    constexpr size_t Codes = 9;
+    std::vector<Champion> current, next;
+    for (int repeat = 0; repeat < 3; ++repeat)
+    {
+        for (size_t c = 0; c < Codes; ++c)
+        {
+            for (size_t n = 0; n < Codes; ++n)
+            {
+                current.push_back(static_cast<Champion>(c == Codes - 1 ? 255 : c));
+                next.push_back(static_cast<Champion>(n == Codes - 1 ? 200 : n));
+            }
+        }
     }
+
+    std::vector<MatrixAction> actions(current.size());
+    checkPrioMatrixBatch(current, next, actions);
+    for (size_t i = 0; i < actions.size(); ++i)
+    {
+        if (actions[i] != checkPrioMatrix(current[i], next[i]))
+        {
+            std::cout << "batch mismatch at " << i << "\n";
+            return false;
+        }
+    }
+    return true;
 }
 
-int main()
+bool verifyRuntimeMatrix()
 {
+    // builtin -> file format -> parsed again must give the compiled matrix
+    std::stringstream file;
+    PrioMatrix::RuntimeMatrix::builtin().save(file);
+    auto matrix = PrioMatrix::RuntimeMatrix::parse(file);
+    for (size_t current = 0; current <= ChampionCount; ++current)
+    {
+        for (size_t next = 0; next <= ChampionCount; ++next)
+        {
+            auto c = static_cast<Champion>(current);
+            auto n = static_cast<Champion>(next);
+            if (matrix.check(c, n) != checkPrioMatrix(c, n))
+            {
+                std::cout << "runtime matrix mismatch for " << c << " -> " << n << "\n";
+                return false;
+            }
+        }
+    }
+
+    // more champions than the enum knows, resolved by name
+    std::istringstream wider(WiderMatrix);
+    PrioMatrix::MatrixStore store(std::move(matrix));
+    store.publish(PrioMatrix::RuntimeMatrix::parse(wider));
+    {
+        auto current = store.read();
+        auto ahri = current->find("Ahri");
+        auto zed = current->find("Zed");
+        if (current->size() != 9 || !ahri || !zed
+            || current->check(*ahri, *zed) != MatrixAction::CONTINUE_CURRENT_HOLD_NEXT
+            || current->check(*zed, *ahri) != MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT
+            || current->check(Champion::Garen, *zed) != MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT)
+        {
+            std::cout << "wider runtime matrix mismatch\n";
+            return false;
+        }
+    }
+
+    // more readers than slots at once: none waits, each keeps the matrix it pinned
+    bool pinned = true;
+    auto hold = [&](auto&& self, int depth) -> void
+    {
+        auto matrix = store.read();
+        if (depth == 0)
+        {
+            store.publish(PrioMatrix::RuntimeMatrix::builtin());
+        }
+        else
+        {
+            self(self, depth - 1);
+        }
+        pinned = pinned && matrix->size() == 9 && matrix->find("Zed");
+    };
+    hold(hold, 100);
+    if (!pinned || store.read()->size() != ChampionCount)
+    {
+        std::cout << "runtime matrix readers beyond the slots mismatch\n";
+        return false;
+    }
+    std::istringstream again(wider.str());
+    store.publish(PrioMatrix::RuntimeMatrix::parse(again));
+
+    // a malformed file is rejected and the published matrix stays
+    std::istringstream broken("champions Garen Teemo\nGaren ^x\nTeemo o\n");
+    try
+    {
+        store.publish(PrioMatrix::RuntimeMatrix::parse(broken));
+        std::cout << "malformed runtime matrix accepted\n";
+        return false;
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+    return store.version() == 3 && store.read()->size() == 9;
+}
+
+int main(int argc, char* argv[])
+{
+    for (size_t current = 0; current < ChampionCount; ++current)
+    {
+        for (size_t next = 0; next < ChampionCount; ++next)
+        {
+            auto c = static_cast<Champion>(current);
+            auto n = static_cast<Champion>(next);
+            if (checkPrioMatrix(c, n) != checkPrioMatrixMap(c, n))
+            {
+                std::cout << "matrix mismatch for " << c << " -> " << n << "\n";
+                return 1;
+            }
+        }
+    }
+
+    if (!verifyBatch() || !verifyRuntimeMatrix() || !verifySessions() || !verifySessionStore())
+    {
+        return 1;
+    }
+
     auto test = checkPrioMatrix(Champion::Teemo, Champion::Caitlyn);
     std::cout<<"test "<<test<<"\n";
+
+    if (argc > 1 && std::strcmp(argv[1], "bench") == 0)
+    {
+        benchmarkPrioMatrix();
+        benchmarkSessions();
+        benchmarkSessionStore();
+    }
+    else if (argc > 2 && std::strcmp(argv[1], "matrix") == 0)
+    {
+        try
+        {
+            auto matrix = PrioMatrix::RuntimeMatrix::load(argv[2]);
+            std::cout << matrix.size() << " champions\n";
+            matrix.save(std::cout);
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cout << e.what() << "\n";
+            return 1;
+        }
+    }
     return 0;
 }
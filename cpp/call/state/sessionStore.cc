@@ -0,0 +1,227 @@
+#include <bit>
+#include <stdexcept>
+
+#include "state/sessionStore.h"
+
+namespace CallState
+{
+    SessionStore::SessionStore(const PrioMatrix::MatrixStore& matrix, size_t capacity, size_t shardCount)
+        : m_matrix(matrix)
+        , m_shards(std::make_unique<Shard[]>(std::bit_ceil(std::max<size_t>(shardCount, 1))))
+        , m_shardCount(std::bit_ceil(std::max<size_t>(shardCount, 1)))
+    {
+        // room for the expected sessions of a shard at a load factor under 3/4
+        auto slots = std::bit_ceil(std::max<size_t>(capacity / m_shardCount * 4 / 3 + 1, RecordsPerBucket));
+        for (size_t i = 0; i < m_shardCount; ++i)
+        {
+            allocate(m_shards[i], slots);
+        }
+    }
+
+    uint64_t SessionStore::hash(LineId line) noexcept
+    {
+        // splitmix64 finalizer: line IDs are often sequential
+        line ^= line >> 30;
+        line *= 0xbf58476d1ce4e5b9ull;
+        line ^= line >> 27;
+        line *= 0x94d049bb133111ebull;
+        line ^= line >> 31;
+        return line;
+    }
+
+    void SessionStore::allocate(Shard& shard, size_t slots)
+    {
+        shard.buckets = std::make_unique<Bucket[]>(slots / RecordsPerBucket);
+        shard.mask = slots - 1;
+        shard.size = 0;
+    }
+
+    void SessionStore::grow(Shard& shard)
+    {
+        auto old = std::move(shard.buckets);
+        auto oldSlots = shard.mask + 1;
+        allocate(shard, oldSlots * 2);
+
+        for (size_t b = 0; b < oldSlots / RecordsPerBucket; ++b)
+        {
+            for (const auto& record : old[b].records)
+            {
+                if (record.line == Empty) continue;
+                auto i = hash(record.line) & shard.mask;
+                while (shard.slot(i).line != Empty)
+                {
+                    i = (i + 1) & shard.mask;
+                }
+                shard.slot(i) = record;
+                ++shard.size;
+            }
+        }
+    }
+
+    void SessionStore::erase(Shard& shard, size_t i)
+    {
+        // backward shift: pull later records of the probe run into the hole as long
+        // as that does not move them before their home slot
+        for (size_t j = (i + 1) & shard.mask;; j = (j + 1) & shard.mask)
+        {
+            auto& candidate = shard.slot(j);
+            if (candidate.line == Empty) break;
+            auto home = hash(candidate.line) & shard.mask;
+            if (((j - home) & shard.mask) >= ((j - i) & shard.mask))
+            {
+                shard.slot(i) = candidate;
+                i = j;
+            }
+        }
+        shard.slot(i) = Record{};
+        --shard.size;
+    }
+
+    Effect SessionStore::dispatchLocked(Shard& shard, uint64_t h, LineId line, CallId call, Event event,
+                                        Champion champion, const PrioMatrix::RuntimeMatrix& matrix)
+    {
+        auto i = h & shard.mask;
+        for (; shard.slot(i).line != Empty; i = (i + 1) & shard.mask)
+        {
+            if (shard.slot(i).line == line) break;
+        }
+
+        auto& found = shard.slot(i);
+        if (found.line == Empty)
+        {
+            // only an incoming call opens a line
+            if (event != Event::Incoming) return Effect::Ignore;
+            if ((shard.size + 1) * 4 > (shard.mask + 1) * 3)
+            {
+                grow(shard);
+                return dispatchLocked(shard, h, line, call, event, champion, matrix);
+            }
+            found = Record{line, Empty, Empty, State::Idle, NoCall, NoCall, {}};
+            ++shard.size;
+        }
+
+        // the call must be in the place the event acts on
+        bool placed = event == Event::Incoming ? call != found.currentCall && call != found.heldCall
+                    : call == (event == Event::Release ? found.currentCall : found.heldCall);
+        auto effect = placed ? step(found.state, found.current, found.held, event, champion, matrix) : Effect::Ignore;
+        switch (effect)
+        {
+            case Effect::Accept:
+            case Effect::Preempt:
+                found.currentCall = call;
+                break;
+            case Effect::Hold:
+                found.heldCall = call;
+                break;
+            case Effect::Resume:
+                found.currentCall = found.heldCall;
+                found.heldCall = Empty;
+                break;
+            case Effect::End:
+                found.currentCall = Empty;
+                break;
+            case Effect::Drop:
+                found.heldCall = Empty;
+                break;
+            case Effect::Ignore:
+            case Effect::Reject:
+                break;
+        }
+
+        if (found.state == State::Idle)
+        {
+            erase(shard, i);
+        }
+        return effect;
+    }
+
+    Effect SessionStore::dispatch(LineId line, CallId call, Event event, Champion champion)
+    {
+        if (line == Empty || call == Empty)
+        {
+            throw std::invalid_argument("line and call ID 0 are reserved");
+        }
+        auto h = hash(line);
+        auto& shard = m_shards[shardIndex(h)];
+        auto matrix = m_matrix.read();
+        std::lock_guard lock(shard.mutex);
+        return dispatchLocked(shard, h, line, call, event, champion, *matrix);
+    }
+
+    void SessionStore::dispatchBatch(std::span<const LineId> lines, std::span<const CallId> calls,
+                                     std::span<const Event> events, std::span<const Champion> champions,
+                                     std::span<Effect> effects)
+    {
+        // counting sort of the batch by shard, stable so one line keeps its order;
+        // the scratch buffers live as long as the thread to keep batches allocation free
+        thread_local std::vector<uint32_t> offsets;
+        thread_local std::vector<uint32_t> order;
+        thread_local std::vector<uint64_t> hashes;
+        offsets.assign(m_shardCount + 1, 0);
+        order.resize(lines.size());
+        hashes.resize(lines.size());
+
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (lines[i] == Empty || calls[i] == Empty)
+            {
+                throw std::invalid_argument("line and call ID 0 are reserved");
+            }
+            hashes[i] = hash(lines[i]);
+            ++offsets[shardIndex(hashes[i]) + 1];
+        }
+        for (size_t s = 0; s < m_shardCount; ++s)
+        {
+            offsets[s + 1] += offsets[s];
+        }
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            order[offsets[shardIndex(hashes[i])]++] = static_cast<uint32_t>(i);
+        }
+
+        // offsets[s] now ends shard s
+        auto matrix = m_matrix.read();
+        size_t begin = 0;
+        for (size_t s = 0; s < m_shardCount; ++s)
+        {
+            auto end = offsets[s];
+            if (begin == end) continue;
+
+            auto& shard = m_shards[s];
+            std::lock_guard lock(shard.mutex);
+            for (auto k = begin; k < end; ++k)
+            {
+                auto i = order[k];
+                effects[i] = dispatchLocked(shard, hashes[i], lines[i], calls[i], events[i], champions[i], *matrix);
+            }
+            begin = end;
+        }
+    }
+
+    std::optional<SessionStore::Session> SessionStore::find(LineId line) const
+    {
+        auto h = hash(line);
+        const auto& shard = m_shards[shardIndex(h)];
+        std::lock_guard lock(shard.mutex);
+        for (auto i = h & shard.mask; shard.slot(i).line != Empty; i = (i + 1) & shard.mask)
+        {
+            const auto& record = shard.slot(i);
+            if (record.line == line)
+            {
+                return Session{record.state, record.current, record.held, record.currentCall, record.heldCall};
+            }
+        }
+        return std::nullopt;
+    }
+
+    size_t SessionStore::size() const
+    {
+        size_t total = 0;
+        for (size_t s = 0; s < m_shardCount; ++s)
+        {
+            std::lock_guard lock(m_shards[s].mutex);
+            total += m_shards[s].size;
+        }
+        return total;
+    }
+}
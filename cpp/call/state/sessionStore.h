@@ -0,0 +1,109 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "state/stateMachine.h"
+
+namespace CallState
+{
+    using LineId = uint64_t;
+    using CallId = uint64_t;
+
+    // Live lines for hundreds of thousands of concurrent calls. A line is what calls
+    // compete for: it runs CallState::step with at most one current and one held
+    // call, so an incoming call is arbitrated against the line's current call with
+    // the matrix published in the MatrixStore (which must outlive the store), and
+    // may be held, rejected or preempt it. Every event names its line and call:
+    // Release ends the line's current call and Cancel withdraws its held one, an
+    // event for a call not in that place is ignored, as is a call placed twice.
+    // The line space is split into shards by hash, each shard an open-addressing
+    // table (linear probing, backward-shift erase) behind its own mutex, so threads
+    // working on different lines rarely meet. Records are 32 bytes packed two per
+    // 64-byte aligned bucket: a probe touches one cache line most of the time and
+    // two shards never share one. A line is inserted by its first Incoming and
+    // erased when it goes back to Idle.
+    class SessionStore
+    {
+    public:
+        struct Session
+        {
+            State state;
+            Champion current;
+            Champion held;
+            CallId currentCall;     // 0 when there is none
+            CallId heldCall;
+        };
+
+        // shardCount is rounded up to a power of two, capacity is the expected
+        // number of live lines (tables grow past it)
+        explicit SessionStore(const PrioMatrix::MatrixStore& matrix, size_t capacity = 1 << 16, size_t shardCount = 64);
+
+        // line 0 and call 0 are reserved, throws std::invalid_argument; champion is
+        // the caller for Incoming and ignored for the other events
+        Effect dispatch(LineId line, CallId call, Event event, Champion champion = NoCall);
+
+        // events[i] for calls[i] with champions[i] applied to lines[i], effects[i]
+        // written. Each shard is locked once per batch and the arbitrations of all
+        // its lines run under that lock; events of one line keep their order. The
+        // whole batch is arbitrated with the matrix published when it starts.
+        // All spans must have the size of lines.
+        void dispatchBatch(std::span<const LineId> lines, std::span<const CallId> calls, std::span<const Event> events,
+                           std::span<const Champion> champions, std::span<Effect> effects);
+
+        std::optional<Session> find(LineId line) const;
+
+        // live lines, exact only when no dispatch runs concurrently
+        size_t size() const;
+
+    private:
+        struct Record
+        {
+            LineId line;        // Empty for a free slot
+            CallId currentCall;
+            CallId heldCall;
+            State state;
+            Champion current;
+            Champion held;
+            uint8_t reserved[5];
+        };
+        static_assert(sizeof(Record) == 32);
+
+        static constexpr uint64_t Empty = 0;
+        static constexpr size_t RecordsPerBucket = 64 / sizeof(Record);
+
+        struct alignas(64) Bucket
+        {
+            Record records[RecordsPerBucket];
+        };
+
+        struct alignas(64) Shard
+        {
+            mutable std::mutex mutex;
+            std::unique_ptr<Bucket[]> buckets;
+            size_t mask = 0;    // slot count - 1
+            size_t size = 0;
+
+            Record& slot(size_t i) const noexcept { return buckets[i / RecordsPerBucket].records[i % RecordsPerBucket]; }
+        };
+
+        static uint64_t hash(LineId line) noexcept;
+
+        // high half of the hash picks the shard, low half the slot
+        size_t shardIndex(uint64_t h) const noexcept { return (h >> 32) & (m_shardCount - 1); }
+
+        // under the shard lock
+        static Effect dispatchLocked(Shard& shard, uint64_t h, LineId line, CallId call, Event event, Champion champion,
+                                     const PrioMatrix::RuntimeMatrix& matrix);
+        static void allocate(Shard& shard, size_t slots);
+        static void grow(Shard& shard);
+        static void erase(Shard& shard, size_t i);
+
+        const PrioMatrix::MatrixStore& m_matrix;
+        std::unique_ptr<Shard[]> m_shards;
+        size_t m_shardCount;
+    };
+}
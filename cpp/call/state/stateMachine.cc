@@ -1,115 +1,64 @@
-#include <typeinfo>
-#include <memory>
-#include "utils/utils.h"
+#include "state/stateMachine.h"
 
-class Context;
-
-// reference: https://refactoring.guru/design-patterns/state/cpp/example
-class State
+namespace CallState
 {
-protected:
-    std::unique_ptr<Context> m_context;
-
-public:
-    virtual ~State() = default;
-
-    void setContext(std::unique_ptr<Context> context)
-    {
-        m_context = std::move(context);
-    }
-
-    virtual void Handle1() = 0;
-    virtual void Handle2() = 0;
-};
-
-/**
- * The Context defines the interface of interest to clients. It also maintains a
- * reference to an instance of a State subclass, which represents the current
- * state of the Context.
- */
-class Context
-{
-private:
-    std::unique_ptr<State> m_state;
-
-public:
-    Context(std::unique_ptr<State> state):
-    m_state(nullptr)
-    {
-        TransitionTo(std::move(state));
-    }
-    ~Context() = default;
-
-    /**
-     * The Context allows changing the State object at runtime.
-     */
-    void TransitionTo(std::unique_ptr<State> state)
-    {
-        std::cout << "Context: Transition to " << typeid(*state).name() << ".\n";
-
-        m_state = std::move(state);
-        m_state->setContext(std::move(this));
-    }
-
-    void Request1()
+    std::ostream& operator<<(std::ostream& os, State s)
     {
-        m_state->Handle1();
+        switch(s)
+        {
+            case State::Idle:       os << "Idle";       break;
+            case State::Active:     os << "Active";     break;
+            case State::Holding:    os << "Holding";    break;
+            default:                os.setstate(std::ios_base::failbit);
+        }
+
+        return os;
     }
 
-    void Request2()
+    std::ostream& operator<<(std::ostream& os, Event e)
     {
-        m_state->Handle2();
+        switch(e)
+        {
+            case Event::Incoming:   os << "Incoming";   break;
+            case Event::Release:    os << "Release";    break;
+            case Event::Cancel:     os << "Cancel";     break;
+            default:                os.setstate(std::ios_base::failbit);
+        }
+
+        return os;
     }
-};
-
-/**
- * Concrete States implement various behaviors, associated with a state of the
- * Context.
- */
 
-class ConcreteStateA : public State
-{
-public:
-    void Handle1() override;
-
-    void Handle2() override
+    std::ostream& operator<<(std::ostream& os, Effect e)
     {
-        std::cout << "ConcreteStateA handles request2.\n";
+        switch(e)
+        {
+            case Effect::Ignore:    os << "Ignore";     break;
+            case Effect::Accept:    os << "Accept";     break;
+            case Effect::Reject:    os << "Reject";     break;
+            case Effect::Hold:      os << "Hold";       break;
+            case Effect::Preempt:   os << "Preempt";    break;
+            case Effect::Resume:    os << "Resume";     break;
+            case Effect::End:       os << "End";        break;
+            case Effect::Drop:      os << "Drop";       break;
+            default:                os.setstate(std::ios_base::failbit);
+        }
+
+        return os;
     }
-};
 
-class ConcreteStateB : public State
-{
-public:
-    void Handle1() override
+    Sessions::Sessions(size_t count, const PrioMatrix::MatrixStore& matrix)
+        : m_matrix(matrix), m_state(count, State::Idle), m_current(count, NoCall), m_held(count, NoCall)
     {
-        std::cout << "ConcreteStateB handles request1.\n";
     }
-    void Handle2() override
-    {
-        std::cout << "ConcreteStateB handles request2.\n";
-        std::cout << "ConcreteStateB wants to change the state of the context.\n";
-        this->context_->TransitionTo(new ConcreteStateA);
-    }
-};
 
-void ConcreteStateA::Handle1()
-{
+    void Sessions::dispatchBatch(std::span<const uint32_t> sessions, std::span<const Event> events,
+                                 std::span<const Champion> champions, std::span<Effect> effects) noexcept
     {
-        std::cout << "ConcreteStateA handles request1.\n";
-        std::cout << "ConcreteStateA wants to change the state of the context.\n";
-
-        this->context_->TransitionTo(new ConcreteStateB);
+        auto matrix = m_matrix.read();
+        for (size_t i = 0; i < sessions.size(); ++i)
+        {
+            auto s = sessions[i];
+            effects[i] = step(m_state[s], m_current[s], m_held[s], events[i], champions[i], *matrix);
+        }
     }
 }
-
-/**
- * The client code.
- */
-void ClientCode()
-{
-    Context *context = new Context(new ConcreteStateA);
-    context->Request1();
-    context->Request2();
-    delete context;
-}
\ No newline at end of file
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <concepts>
+#include <span>
+
+#include "common/definition.h"
+#include "common/matrixStore.h"
+#include "common/prioMatrix.h"
+
+// Call-session state machine. A session is one line: at most one current call and
+// one held call, each identified by the Champion that placed it. Transitions come
+// from a compile-time table keyed by (state, event, matrix decision), the decision
+// being matrix.check(current, incoming) for Incoming and NODEF otherwise. On an
+// idle line there is no current call to arbitrate against: a caller the matrix
+// knows decides TERMINATE_CURRENT_EXECUTE_NEXT, an unknown one NODEF.
+// Sessions and SessionStore arbitrate with the matrix published in a MatrixStore,
+// so a reload applies to the next event, champions beyond the enum included.
+namespace CallState
+{
+    enum class State : uint8_t
+    {
+        Idle,       // no call
+        Active,     // current call running
+        Holding,    // current call running, one call held behind it
+    };
+    constexpr size_t StateCount = 3;
+
+    enum class Event : uint8_t
+    {
+        Incoming,   // a champion places a call on the line
+        Release,    // the current call ends
+        Cancel,     // the held call is withdrawn
+    };
+    constexpr size_t EventCount = 3;
+
+    // what the engine did to the session, returned to the caller for each event
+    enum class Effect : uint8_t
+    {
+        Ignore,     // event meaningless in this state
+        Accept,     // incoming becomes current
+        Reject,     // incoming refused
+        Hold,       // incoming held behind current
+        Preempt,    // current terminated, incoming becomes current
+        Resume,     // current ended, held becomes current
+        End,        // current ended, line idle
+        Drop,       // held call removed
+    };
+
+    std::ostream& operator<<(std::ostream& os, State s);
+    std::ostream& operator<<(std::ostream& os, Event e);
+    std::ostream& operator<<(std::ostream& os, Effect e);
+
+    // no call: out of range of any matrix, so arbitration answers NODEF
+    constexpr Champion NoCall = static_cast<Champion>(UINT8_MAX);
+
+    struct Transition
+    {
+        State next;
+        Effect effect;
+    };
+
+    constexpr size_t DecisionCount = Utils::to_underlying(MatrixAction::NODEF) + 1;
+
+    namespace Detail
+    {
+        struct Rule
+        {
+            State state;
+            Event event;
+            MatrixAction decision;  // NODEF stands for any decision
+            Transition transition;
+        };
+
+        using Table = std::array<std::array<std::array<Transition, DecisionCount>, EventCount>, StateCount>;
+
+        constexpr auto REJECT   = MatrixAction::CONTINUE_CURRENT_REJECT_NEXT;
+        constexpr auto HOLD     = MatrixAction::CONTINUE_CURRENT_HOLD_NEXT;
+        constexpr auto PREEMPT  = MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT;
+        constexpr auto ANY      = MatrixAction::NODEF;
+
+        // a single held slot: a second call the matrix would hold is rejected,
+        // a preempting call keeps the held one waiting
+        constexpr Rule Rules[]
+        {
+            {State::Idle,       Event::Incoming,    PREEMPT,    {State::Active,     Effect::Accept}},
+            {State::Idle,       Event::Release,     ANY,        {State::Idle,       Effect::Ignore}},
+            {State::Idle,       Event::Cancel,      ANY,        {State::Idle,       Effect::Ignore}},
+
+            {State::Active,     Event::Incoming,    REJECT,     {State::Active,     Effect::Reject}},
+            {State::Active,     Event::Incoming,    HOLD,       {State::Holding,    Effect::Hold}},
+            {State::Active,     Event::Incoming,    PREEMPT,    {State::Active,     Effect::Preempt}},
+            {State::Active,     Event::Release,     ANY,        {State::Idle,       Effect::End}},
+            {State::Active,     Event::Cancel,      ANY,        {State::Active,     Effect::Ignore}},
+
+            {State::Holding,    Event::Incoming,    REJECT,     {State::Holding,    Effect::Reject}},
+            {State::Holding,    Event::Incoming,    HOLD,       {State::Holding,    Effect::Reject}},
+            {State::Holding,    Event::Incoming,    PREEMPT,    {State::Holding,    Effect::Preempt}},
+            {State::Holding,    Event::Release,     ANY,        {State::Active,     Effect::Resume}},
+            {State::Holding,    Event::Cancel,      ANY,        {State::Active,     Effect::Drop}},
+        };
+
+        consteval Table build()
+        {
+            Table table{};
+            std::array<std::array<std::array<bool, DecisionCount>, EventCount>, StateCount> defined{};
+            for (const auto& rule : Rules)
+            {
+                auto s = Utils::to_underlying(rule.state);
+                auto e = Utils::to_underlying(rule.event);
+                for (size_t d = 0; d < DecisionCount; ++d)
+                {
+                    if (rule.decision != ANY && Utils::to_underlying(rule.decision) != d) continue;
+                    if (defined[s][e][d]) throw "overlapping rules for the same (state, event, decision)";
+                    defined[s][e][d] = true;
+                    table[s][e][d] = rule.transition;
+                }
+            }
+
+            // Incoming with NODEF comes from an invalid caller and leaves the
+            // session as is, an idle line never decides REJECT or HOLD;
+            // everything else needs a rule
+            for (size_t s = 0; s < StateCount; ++s)
+            {
+                for (size_t e = 0; e < EventCount; ++e)
+                {
+                    for (size_t d = 0; d < DecisionCount; ++d)
+                    {
+                        bool unreachable = static_cast<Event>(e) == Event::Incoming
+                                        && (d == Utils::to_underlying(ANY) || static_cast<State>(s) == State::Idle);
+                        if (defined[s][e][d]) continue;
+                        if (!unreachable) throw "missing rule";
+                        table[s][e][d] = {static_cast<State>(s), Effect::Ignore};
+                    }
+                }
+            }
+            return table;
+        }
+    }
+
+    constexpr Detail::Table Table = Detail::build();
+
+    constexpr Transition transition(State state, Event event, MatrixAction decision) noexcept
+    {
+        return Table[Utils::to_underlying(state)][Utils::to_underlying(event)][Utils::to_underlying(decision)];
+    }
+
+    static_assert(transition(State::Active, Event::Incoming, MatrixAction::CONTINUE_CURRENT_HOLD_NEXT).next == State::Holding);
+    static_assert(transition(State::Holding, Event::Release, MatrixAction::NODEF).effect == Effect::Resume);
+    static_assert(transition(State::Holding, Event::Incoming, MatrixAction::NODEF).next == State::Holding);
+    static_assert(transition(State::Idle, Event::Incoming, MatrixAction::NODEF).next == State::Idle);
+
+    // what step() arbitrates with: a RuntimeMatrix, or BuiltinMatrix in constant
+    // expressions; check() answers NODEF exactly for codes it does not know
+    template <typename M>
+    concept Matrix = requires(const M& matrix, Champion champion)
+    {
+        { matrix.check(champion, champion) } noexcept -> std::same_as<MatrixAction>;
+    };
+
+    struct BuiltinMatrix
+    {
+        static constexpr MatrixAction check(Champion current, Champion next) noexcept
+        {
+            return checkPrioMatrix(current, next);
+        }
+    };
+    static_assert(Matrix<BuiltinMatrix> && Matrix<PrioMatrix::RuntimeMatrix>);
+
+    // One event on one session given by reference to its fields, shared by the
+    // SoA sessions and the session store; champion is the caller for Incoming
+    // and ignored for the other events.
+    template <Matrix M>
+    constexpr Effect step(State& state, Champion& current, Champion& held, Event event, Champion champion,
+                          const M& matrix) noexcept
+    {
+        auto decision = MatrixAction::NODEF;
+        if (event == Event::Incoming)
+        {
+            // every known champion has its diagonal entry
+            decision = state != State::Idle ? matrix.check(current, champion)
+                     : matrix.check(champion, champion) != MatrixAction::NODEF ? MatrixAction::TERMINATE_CURRENT_EXECUTE_NEXT
+                     : MatrixAction::NODEF;
+        }
+        auto [next, effect] = transition(state, event, decision);
+
+        state = next;
+        switch (effect)
+        {
+            case Effect::Accept:
+            case Effect::Preempt:
+                current = champion;
+                break;
+            case Effect::Hold:
+                held = champion;
+                break;
+            case Effect::Resume:
+                current = held;
+                held = NoCall;
+                break;
+            case Effect::End:
+                current = NoCall;
+                break;
+            case Effect::Drop:
+                held = NoCall;
+                break;
+            case Effect::Ignore:
+            case Effect::Reject:
+                break;
+        }
+        return effect;
+    }
+
+    // an invalid caller cannot take an idle line, a valid one can
+    static_assert([]
+    {
+        State state = State::Idle;
+        Champion current = NoCall, held = NoCall;
+        return step(state, current, held, Event::Incoming, NoCall, BuiltinMatrix{}) == Effect::Ignore
+            && state == State::Idle && current == NoCall
+            && step(state, current, held, Event::Incoming, Champion::Nunu, BuiltinMatrix{}) == Effect::Accept
+            && current == Champion::Nunu;
+    }());
+
+    // Millions of independent sessions stored SoA: one byte of state and two
+    // champion codes per session, indexed by a dense session number. Dispatching
+    // an event is one matrix lookup, one table lookup and a few byte stores.
+    // The matrix store must outlive the sessions.
+    class Sessions
+    {
+    public:
+        Sessions(size_t count, const PrioMatrix::MatrixStore& matrix);
+
+        size_t size() const noexcept { return m_state.size(); }
+
+        State state(size_t session) const noexcept { return m_state[session]; }
+        Champion current(size_t session) const noexcept { return m_current[session]; }
+        Champion held(size_t session) const noexcept { return m_held[session]; }
+
+        // champion is the caller for Incoming and ignored for the other events
+        Effect dispatch(size_t session, Event event, Champion champion = NoCall) noexcept
+        {
+            auto matrix = m_matrix.read();
+            return step(m_state[session], m_current[session], m_held[session], event, champion, *matrix);
+        }
+
+        // events[i] with champions[i] applied to sessions[i] in order, effects[i] written;
+        // all spans must have the size of sessions. The whole batch is arbitrated
+        // with the matrix published when it starts.
+        void dispatchBatch(std::span<const uint32_t> sessions, std::span<const Event> events,
+                           std::span<const Champion> champions, std::span<Effect> effects) noexcept;
+
+    private:
+        const PrioMatrix::MatrixStore& m_matrix;
+        std::vector<State> m_state;
+        std::vector<Champion> m_current;
+        std::vector<Champion> m_held;
+    };
+}
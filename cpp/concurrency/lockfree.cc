@@ -3,10 +3,13 @@
 #include <vector>
 #include <atomic>
 #include <mutex>
-#include <chrono>
+#include <stdexcept>
+#include <string>
 
-const int NUM_THREADS = 8;
-const int NUM_TRANSACTIONS = 1000000;
+#include "benchmark.h"
+
+// transactions per thread in one benchmark iteration, the thread count is the argument
+const int NUM_TRANSACTIONS = 10000;
 
 // Atomic Account
 struct AtomicAccount {
@@ -87,54 +90,44 @@ void lock_free_worker(LockFreeAccount& account) {
     }
 }
 
-int main() {
-    AtomicAccount atomic_acc;
-    MutexAccount mutex_acc;
-    LockFreeAccount lock_free_acc;
-
-    // Atomic Test
-    auto start_atomic = std::chrono::high_resolution_clock::now();
-    std::vector<std::thread> atomic_threads;
-    for (int i = 0; i < NUM_THREADS; ++i) {
-        atomic_threads.emplace_back(atomic_worker, std::ref(atomic_acc));
-    }
-    for (auto& t : atomic_threads) {
-        t.join();
-    }
-    auto end_atomic = std::chrono::high_resolution_clock::now();
-    std::cout << "Atomic Account Balance: " << atomic_acc.balance << "\n";
-
-    // Mutex Test
-    auto start_mutex = std::chrono::high_resolution_clock::now();
-    std::vector<std::thread> mutex_threads;
-    for (int i = 0; i < NUM_THREADS; ++i) {
-        mutex_threads.emplace_back(mutex_worker, std::ref(mutex_acc));
-    }
-    for (auto& t : mutex_threads) {
-        t.join();
-    }
-    auto end_mutex = std::chrono::high_resolution_clock::now();
-    std::cout << "Mutex Account Balance: " << mutex_acc.balance << "\n";
-
-    // Lock-Free Test
-    auto start_lock_free = std::chrono::high_resolution_clock::now();
-    std::vector<std::thread> lock_free_threads;
-    for (int i = 0; i < NUM_THREADS; ++i) {
-        lock_free_threads.emplace_back(lock_free_worker, std::ref(lock_free_acc));
-    }
-    for (auto& t : lock_free_threads) {
-        t.join();
+int balance_of(const AtomicAccount& account) { return account.balance.load(); }
+int balance_of(const MutexAccount& account) { return account.balance; }
+int balance_of(const LockFreeAccount& account) { return account.get_balance(); }
+
+// one iteration: state.arg() threads each running worker on a fresh account
+template <typename Account, void (*Worker)(Account&)>
+void run_threads(Utils::Bench::State& state) {
+    for (auto _ : state) {
+        Account account;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < state.arg(); ++i) {
+            threads.emplace_back(Worker, std::ref(account));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        Utils::Bench::DoNotOptimize(account);
+
+        // every withdraw(1) follows a deposit(1) of the same thread, so it always
+        // succeeds and the state.arg() * NUM_TRANSACTIONS deposits are all taken back
+        state.pauseTiming();
+        if (balance_of(account) != 0) {
+            throw std::runtime_error("balance " + std::to_string(balance_of(account)) + " after "
+                                     + std::to_string(state.arg() * NUM_TRANSACTIONS) + " deposits and withdrawals, expected 0");
+        }
+        state.resumeTiming();
     }
-    auto end_lock_free = std::chrono::high_resolution_clock::now();
-    std::cout << "Lock-Free Account Balance: " << lock_free_acc.get_balance() << "\n";
+}
 
-    std::chrono::duration<double> atomic_time = end_atomic - start_atomic;
-    std::chrono::duration<double> mutex_time = end_mutex - start_mutex;
-    std::chrono::duration<double> lock_free_time = end_lock_free - start_lock_free;
+void atomic_account(Utils::Bench::State& state) { run_threads<AtomicAccount, atomic_worker>(state); }
+void mutex_account(Utils::Bench::State& state) { run_threads<MutexAccount, mutex_worker>(state); }
+void lock_free_account(Utils::Bench::State& state) { run_threads<LockFreeAccount, lock_free_worker>(state); }
 
-    std::cout << "Atomic Time: " << atomic_time.count() << " seconds\n";
-    std::cout << "Mutex Time: " << mutex_time.count() << " seconds\n";
-    std::cout << "Lock-Free Time: " << lock_free_time.count() << " seconds\n";
+UTILS_BENCHMARK(atomic_account, 1, 2, 8);
+UTILS_BENCHMARK(mutex_account, 1, 2, 8);
+UTILS_BENCHMARK(lock_free_account, 1, 2, 8);
 
-    return 0;
+// e.g. ./lockfree --filter=/8 --counters --json=lockfree.json
+int main(int argc, char* argv[]) {
+    return Utils::Bench::run(argc, argv);
 }
@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "benchmark.h"
 
 class Worker {
 public:
@@ -17,7 +18,42 @@ void task2() // detach-> expect the inside's log show outside of start-end
     std::cout << "Task 2 is running.\n";
 }
 
-int main()
+// one iteration: sums 1'000'000 ones with state.arg() threads, each on its own chunk
+void partialSumThreads(Utils::Bench::State& state)
+{
+    auto partialSum = [](const std::vector<int>& data, size_t start, size_t end, long long& result) {
+        result = std::accumulate(data.begin() + start, data.begin() + end, 0LL);
+    };
+
+    const size_t size = 1'000'000;
+    std::vector<int> data(size, 1); // Fill with 1s
+    auto numThreads = static_cast<size_t>(state.arg());
+
+    for (auto _ : state)
+    {
+        size_t chunkSize = size / numThreads;
+
+        std::vector<std::thread> threads;
+        std::vector<long long> results(numThreads);
+
+        for (size_t i = 0; i < numThreads; ++i) {
+            size_t start = i * chunkSize;
+            size_t end = (i == numThreads - 1) ? size : start + chunkSize;
+
+            threads.emplace_back(partialSum, std::cref(data), start, end, std::ref(results[i]));
+        }
+
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        long long totalSum = std::accumulate(results.begin(), results.end(), 0LL);
+        Utils::Bench::DoNotOptimize(totalSum);
+    }
+}
+UTILS_BENCHMARK(partialSumThreads, 1, 2, 3, 4);
+
+int main(int argc, char* argv[])
 {
     MAGENTA("task1::start");
     {
@@ -268,39 +304,8 @@ int main()
 
     MAGENTA("task9::shared_data::start");
     {
-        auto partialSum = [](const std::vector<int>& data, size_t start, size_t end, long long& result) {
-            result = std::accumulate(data.begin() + start, data.begin() + end, 0LL);
-        };
-
-        const size_t size = 1'000'000;
-        std::vector<int> data(size, 1); // Fill with 1s
-
-        auto doSum = [partialSum, size, data](size_t numThreads)
-        {
-            size_t chunkSize = size / numThreads;
-
-            std::vector<std::thread> threads;
-            std::vector<long long> results(numThreads);
-
-            for (size_t i = 0; i < numThreads; ++i) {
-                size_t start = i * chunkSize;
-                size_t end = (i == numThreads - 1) ? size : start + chunkSize;
-
-                threads.emplace_back(partialSum, std::ref(data), start, end, std::ref(results[i]));
-            }
-
-            for (auto& t : threads) {
-                t.join();
-            }
-
-            long long totalSum = std::accumulate(results.begin(), results.end(), 0LL);
-            std::cout << "Total sum: " << totalSum << "\n";
-        };
-
-        Utils::time_elapsed(doSum, "1 thread", 1);
-        Utils::time_elapsed(doSum, "2 thread", 2);
-        Utils::time_elapsed(doSum, "3 thread", 3);
-        Utils::time_elapsed(doSum, "4 thread", 4);
+        // the sum of 1'000'000 ones split over 1 to 4 threads, see partialSumThreads
+        Utils::Bench::run(argc, argv);
     }
     MAGENTA("task9::shared_data::end");
 
@@ -1,15 +1,17 @@
+#include <algorithm>
 #include <array>
-#include <cstdint>
+#include <charconv>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
-#include <map>
-#include <set>
-#include <sstream>
 #include <ostream>
+#include <random>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <utility>
+#include <variant>
 #include <vector>
 
 enum class eState
@@ -20,6 +22,21 @@ enum class eState
     PaymentSuccess,
     Unlocked
 };
+constexpr size_t StateCount = 5;
+
+std::ostream& operator<<(std::ostream& os, eState en)
+{
+    switch(en)
+    {
+        case eState::Locked:            os << "Locked";             break;
+        case eState::PaymentProcessing: os << "PaymentProcessing";  break;
+        case eState::PaymentFailed:     os << "PaymentFailed";      break;
+        case eState::PaymentSuccess:    os << "PaymentSuccess";     break;
+        case eState::Unlocked:          os << "Unlocked";           break;
+        default:                        os.setstate(std::ios_base::failbit);
+    }
+    return os;
+}
 
 struct CardPresented
 {
@@ -48,10 +65,62 @@ struct Timeout
 {
 };
 
+using Event = std::variant<CardPresented, TransactionDeclined, TransactionSuccess, PersonPassed, Timeout>;
+
+// Screen rows are kept in fixed inline buffers: setting a row copies the text
+// into the terminal, so callers may pass views of temporaries, and formatting
+// a row never allocates. Text longer than a row is truncated, like format_to_n.
 class POSTerminal
 {
 public:
-    explicit POSTerminal(std::string_view firstRow) : m_firstRow(firstRow)
+    static constexpr size_t RowCapacity = 32;
+
+    class Row
+    {
+    public:
+        Row() = default;
+        Row(std::string_view text) { append(text); }
+
+        // concatenation of string pieces and integers, e.g. format("Fare: ", 5)
+        template <typename... Args>
+        static Row format(const Args&... args)
+        {
+            Row row;
+            (row.appendValue(args), ...);
+            return row;
+        }
+
+        std::string_view view() const { return {m_text.data(), m_size}; }
+        operator std::string_view() const { return view(); }
+
+    private:
+        void append(std::string_view text)
+        {
+            auto count = std::min(text.size(), RowCapacity - m_size);
+            std::copy_n(text.data(), count, m_text.data() + m_size);
+            m_size += count;
+        }
+
+        template <typename T>
+        void appendValue(const T& value)
+        {
+            if constexpr (std::is_integral_v<T>)
+            {
+                char digits[24];
+                auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+                append(std::string_view(digits, end - digits));
+            }
+            else
+            {
+                append(std::string_view(value));
+            }
+        }
+
+        std::array<char, RowCapacity> m_text{};
+        size_t m_size{0};
+    };
+
+    POSTerminal(std::ostream& out, std::string_view firstRow) : m_out(out), m_rows{Row(firstRow)}
     {
     }
 
@@ -59,20 +128,17 @@ public:
                  std::string_view secondRow = "",
                  std::string_view thirdRow = "")
     {
-        m_firstRow = firstRow;
-        m_secondRow = secondRow;
-        m_thirdRow = thirdRow;
-        std::cout << "Screen: " << m_firstRow << " " << m_secondRow << " " << m_thirdRow << "\n";
+        m_rows = {Row(firstRow), Row(secondRow), Row(thirdRow)};
+        m_out << "Screen: " << getFirstRow() << " " << getSecondRow() << " " << getThirdRow() << "\n";
     }
 
-    std::string_view getFirstRow() const { return m_firstRow; }
-    std::string_view getSecondRow() const { return m_secondRow; }
-    std::string_view getThirdRow() const { return m_thirdRow; }
+    std::string_view getFirstRow() const { return m_rows[0]; }
+    std::string_view getSecondRow() const { return m_rows[1]; }
+    std::string_view getThirdRow() const { return m_rows[2]; }
 
 private:
-    std::string_view m_firstRow;
-    std::string_view m_secondRow;
-    std::string_view m_thirdRow;
+    std::ostream& m_out;
+    std::array<Row, 3> m_rows;
 };
 
 class SwingDoor
@@ -83,19 +149,23 @@ public:
         Closed,
         Open
     };
+    explicit SwingDoor(std::ostream& out) : m_out(out)
+    {
+    }
     void open()
     {
-        std::cout << "Door is open\n";
+        m_out << "Door is open\n";
         m_status = LEDPattern::Open;
     }
     void close()
     {
-        std::cout << "Door is closed\n";
+        m_out << "Door is closed\n";
         m_status = LEDPattern::Closed;
     }
     LEDPattern getStatus() const { return m_status; }
 
 private:
+    std::ostream& m_out;
     LEDPattern m_status{LEDPattern::Closed};
 };
 
@@ -123,163 +193,877 @@ std::ostream& operator<<(std::ostream& os, LEDPattern en)
 class LEDController
 {
 public:
+    explicit LEDController(std::ostream& out) : m_out(out)
+    {
+    }
 
     void setStatus(LEDPattern status)
     {
-        std::cout << "LED: "<<status<<"\n";
+        m_out << "LED: "<<status<<"\n";
         m_status = status;
     };
 
     LEDPattern getStatus() const { return m_status; }
 
 private:
+    std::ostream& m_out;
     LEDPattern m_status{LEDPattern::RedCross};
 };
 
-class FSM
+enum class ScreenMessage : uint8_t
+{
+    Booting,
+    TouchCard,
+    Processing,
+    Declined,
+    NetworkError,
+    Approved,
+    ApprovedFare    // Approved with fare and balance on the second row
+};
+
+// A device command is the state a device must reach, not a delta: replaying
+// only the latest commands of a device still leaves it in the right state.
+struct DeviceCommand
 {
+    enum class Device : uint8_t
+    {
+        Screen,
+        Door,
+        Led
+    };
+
+    Device device;
+    uint8_t value;      // ScreenMessage, door open (1) / closed (0), LEDPattern
+    int fare{0};        // ApprovedFare only
+    int balance{0};
+
+    bool operator==(const DeviceCommand&) const = default;
+};
+
+// Per-FSM command buffer filled by the transitions and drained by the I/O stage.
+// Never blocks the state logic: when the I/O stage falls a whole ring behind,
+// the oldest command is overwritten (counted in superseded()), which only skips
+// an intermediate device state since commands are absolute.
+template <size_t Capacity>
+class CommandRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
 public:
-    FSM()
+    void push(const DeviceCommand& command)
     {
-        m_door.close();
-        m_led.setStatus(LEDPattern::RedCross);
-        m_pos.setRows("Booting");
+        if (m_tail - m_head == Capacity)
+        {
+            ++m_head;
+            ++m_superseded;
+        }
+        m_commands[m_tail++ % Capacity] = command;
+    }
 
-        std::cout << "System was boot OK with state Locked\n";
+    template <typename Func>
+    size_t drain(Func&& func)
+    {
+        auto count = m_tail - m_head;
+        for (; m_head != m_tail; ++m_head)
+        {
+            func(m_commands[m_head % Capacity]);
+        }
+        return count;
     }
-    FSM &process(CardPresented event);
-    FSM &process(TransactionDeclined event);
-    FSM &process(TransactionSuccess event);
-    FSM &process(PersonPassed event);
-    FSM &process(Timeout event);
-    eState getState() const { return m_state; };
-    void transitionToPaymentProcessing();
-    void transitionToLocked();
-    void transitionToUnlocked();
-    void transitionToPaymentSuccessful(int fare, int balance);
+
+    bool empty() const { return m_head == m_tail; }
+    size_t superseded() const { return m_superseded; }
 
 private:
-    eState m_state{eState::Locked};
-    SwingDoor m_door{};
-    POSTerminal m_pos{"Touch Card"};
-    LEDController m_led{};
+    std::array<DeviceCommand, Capacity> m_commands{};
+    uint32_t m_head{0};
+    uint32_t m_tail{0};
+    size_t m_superseded{0};
 };
 
-void FSM::transitionToPaymentProcessing()
+// I/O stage of one turnstile: owns the devices, applies queued commands and
+// drops those that would not change a device (closing a closed door, the LED
+// pattern or the screen text already shown). The first command of each
+// device always goes out, its state at boot is unknown.
+class DeviceIO
 {
-    m_state = eState::PaymentProcessing;
-    m_pos.setRows("Processing");
-    m_door.close();
-    m_led.setStatus(LEDPattern::OrangeCross);
-}
+public:
+    explicit DeviceIO(std::ostream& out) : m_pos(out, ""), m_door(out), m_led(out)
+    {
+    }
 
-FSM &FSM::process(CardPresented event)
-{
-    switch (m_state)
+    template <size_t Capacity>
+    void flush(CommandRing<Capacity>& commands)
     {
-    case eState::Locked:
-        transitionToPaymentProcessing();
-        break;
-    default:
-        break;
+        m_queued += commands.drain([this](const DeviceCommand& command)
+        {
+            auto& last = m_last[static_cast<size_t>(command.device)];
+            if (last == command) return;
+            last = command;
+            apply(command);
+            ++m_written;
+        });
     }
-    return *this;
-}
 
-FSM &FSM::process(TransactionDeclined event)
+    size_t queued() const { return m_queued; }
+    size_t written() const { return m_written; }
+
+private:
+    void apply(const DeviceCommand& command)
+    {
+        switch (command.device)
+        {
+            case DeviceCommand::Device::Screen: show(static_cast<ScreenMessage>(command.value), command); break;
+            case DeviceCommand::Device::Door:   command.value ? m_door.open() : m_door.close();        break;
+            case DeviceCommand::Device::Led:    m_led.setStatus(static_cast<LEDPattern>(command.value)); break;
+        }
+    }
+
+    void show(ScreenMessage message, const DeviceCommand& command)
+    {
+        switch (message)
+        {
+            case ScreenMessage::Booting:        m_pos.setRows("Booting");       break;
+            case ScreenMessage::TouchCard:      m_pos.setRows("Touch Card");    break;
+            case ScreenMessage::Processing:     m_pos.setRows("Processing");    break;
+            case ScreenMessage::Declined:       m_pos.setRows("Declined");      break;
+            case ScreenMessage::NetworkError:   m_pos.setRows("Network error"); break;
+            case ScreenMessage::Approved:       m_pos.setRows("Approved");      break;
+            case ScreenMessage::ApprovedFare:
+                m_pos.setRows("Approved", POSTerminal::Row::format("Fare: ", command.fare, ", balance: ", command.balance));
+                break;
+        }
+    }
+
+    POSTerminal m_pos;
+    SwingDoor m_door;
+    LEDController m_led;
+
+    // last command applied per device, value 0xff until the first one
+    std::array<DeviceCommand, 3> m_last
+    {
+        DeviceCommand{DeviceCommand::Device::Screen, 0xff},
+        DeviceCommand{DeviceCommand::Device::Door, 0xff},
+        DeviceCommand{DeviceCommand::Device::Led, 0xff},
+    };
+    size_t m_queued{0};
+    size_t m_written{0};
+};
+
+// Generic engine: a machine lists its transitions as Row types, the engine turns
+// them into a (state x event) table of function pointers at compile time.
+// Firing a row runs Context::onExit<From>(), the optional row action with the
+// typed event, then Context::onEntry<To>(); a missing row ignores the event.
+// Nothing allocates: events are variants passed by reference, the table is static.
+namespace fsm
 {
-    switch (m_state)
-    {
-    case eState::PaymentProcessing:
-        m_state = eState::PaymentFailed;
-        m_pos.setRows("Declined");
-        m_door.close();
-        m_led.setStatus(LEDPattern::FlashRedCross);
-        break;
-    default:
-        break;
-    }
-    return *this;
+    template <auto From, typename E, auto To, auto Action = nullptr>
+    struct Row
+    {
+        static constexpr auto from = From;
+        static constexpr auto to = To;
+        static constexpr auto action = Action;
+        using event = E;
+    };
+
+    template <typename E, typename Variant>
+    struct variant_index;
+
+    template <typename E, typename... Ts>
+    struct variant_index<E, std::variant<Ts...>>
+    {
+        static constexpr size_t value = []
+        {
+            constexpr bool matches[] = {std::is_same_v<E, Ts>...};
+            size_t found = sizeof...(Ts);
+            for (size_t i = 0; i < sizeof...(Ts); ++i)
+            {
+                if (matches[i])
+                {
+                    if (found != sizeof...(Ts)) throw "event type listed twice in the variant";
+                    found = i;
+                }
+            }
+            if (found == sizeof...(Ts)) throw "event type not in the variant";
+            return found;
+        }();
+    };
+
+    // Context provides: State (enum), Event (std::variant), StateCount,
+    // Transitions (std::tuple of Row), template <State> onEntry() / onExit()
+    template <typename Context>
+    class Engine
+    {
+        using State = typename Context::State;
+        using Event = typename Context::Event;
+        using Handler = State (*)(Context&, const Event&);
+
+        static constexpr size_t EventCount = std::variant_size_v<Event>;
+        using Table = std::array<std::array<Handler, EventCount>, Context::StateCount>;
+
+        template <typename R>
+        static State fire(Context& context, const Event& event)
+        {
+            context.template onExit<R::from>();
+            if constexpr (!std::is_null_pointer_v<std::remove_const_t<decltype(R::action)>>)
+            {
+                (context.*R::action)(*std::get_if<typename R::event>(&event));
+            }
+            context.template onEntry<R::to>();
+            return R::to;
+        }
+
+        template <typename R>
+        static constexpr void add(Table& table)
+        {
+            auto& slot = table[static_cast<size_t>(R::from)][variant_index<typename R::event, Event>::value];
+            if (slot != nullptr) throw "two transitions for the same (state, event)";
+            slot = &fire<R>;
+        }
+
+        static consteval Table build()
+        {
+            Table table{};
+            [&]<typename... Rows>(std::tuple<Rows...>*)
+            {
+                (add<Rows>(table), ...);
+            }(static_cast<typename Context::Transitions*>(nullptr));
+            return table;
+        }
+
+        static constexpr Table table = build();
+
+    public:
+        static State dispatch(Context& context, State state, const Event& event)
+        {
+            auto handler = table[static_cast<size_t>(state)][event.index()];
+            return handler ? handler(context, event) : state;
+        }
+    };
 }
-FSM &FSM::process(TransactionSuccess event)
+
+class FSM
 {
-    switch (m_state)
+public:
+    using State = eState;
+    using Event = ::Event;
+    static constexpr size_t StateCount = ::StateCount;
+    using Commands = CommandRing<16>;
+
+    FSM()
     {
-    case eState::PaymentProcessing:
-        transitionToPaymentSuccessful(event.fare, event.balance);
-        break;
-    default:
-        break;
+        door(false);
+        led(LEDPattern::RedCross);
+        screen(ScreenMessage::Booting);
     }
-    return *this;
-}
-FSM &FSM::process(PersonPassed event)
-{
-    switch (m_state)
+
+    FSM& process(const Event& event)
     {
-    case eState::PaymentSuccess:
-    case eState::Unlocked:
-        transitionToLocked();
-        break;
-    default:
-        break;
+        m_state = fsm::Engine<FSM>::dispatch(*this, m_state, event);
+        return *this;
     }
-    return *this;
-}
 
-void FSM::transitionToLocked()
+    eState getState() const { return m_state; };
+
+    // device commands not yet flushed by the I/O stage
+    Commands& commands() { return m_commands; }
+
+    // device state is driven by entry actions, door and LED depend on the state only
+    template <eState S>
+    void onEntry()
+    {
+        if constexpr (S == eState::Locked)
+        {
+            screen(ScreenMessage::TouchCard);
+            door(false);
+            led(LEDPattern::RedCross);
+        }
+        else if constexpr (S == eState::PaymentProcessing)
+        {
+            screen(ScreenMessage::Processing);
+            door(false);
+            led(LEDPattern::OrangeCross);
+        }
+        else if constexpr (S == eState::PaymentFailed)
+        {
+            door(false);
+            led(LEDPattern::FlashRedCross);
+        }
+        else if constexpr (S == eState::PaymentSuccess)
+        {
+            door(true);
+            led(LEDPattern::GreenArrow);
+        }
+        else if constexpr (S == eState::Unlocked)
+        {
+            door(true);
+            screen(ScreenMessage::Approved);
+            led(LEDPattern::GreenArrow);
+        }
+    }
+
+    template <eState S>
+    void onExit()
+    {
+    }
+
+    // transition actions: screen text depends on why the state was entered
+    void showDeclined(const TransactionDeclined&) { screen(ScreenMessage::Declined); }
+    void showNetworkError(const Timeout&) { screen(ScreenMessage::NetworkError); }
+    void showFare(const TransactionSuccess& event)
+    {
+        m_commands.push({DeviceCommand::Device::Screen, static_cast<uint8_t>(ScreenMessage::ApprovedFare), event.fare, event.balance});
+    }
+
+    using Transitions = std::tuple<
+        fsm::Row<eState::Locked,            CardPresented,          eState::PaymentProcessing>,
+        fsm::Row<eState::PaymentProcessing, TransactionDeclined,    eState::PaymentFailed,      &FSM::showDeclined>,
+        fsm::Row<eState::PaymentProcessing, TransactionSuccess,     eState::PaymentSuccess,     &FSM::showFare>,
+        fsm::Row<eState::PaymentProcessing, Timeout,                eState::PaymentFailed,      &FSM::showNetworkError>,
+        fsm::Row<eState::PaymentFailed,     Timeout,                eState::Locked>,
+        fsm::Row<eState::PaymentSuccess,    Timeout,                eState::Unlocked>,
+        fsm::Row<eState::PaymentSuccess,    PersonPassed,           eState::Locked>,
+        fsm::Row<eState::Unlocked,          PersonPassed,           eState::Locked>>;
+
+private:
+    void screen(ScreenMessage message) { m_commands.push({DeviceCommand::Device::Screen, static_cast<uint8_t>(message)}); }
+    void door(bool open) { m_commands.push({DeviceCommand::Device::Door, static_cast<uint8_t>(open)}); }
+    void led(LEDPattern pattern) { m_commands.push({DeviceCommand::Device::Led, static_cast<uint8_t>(pattern)}); }
+
+    eState m_state{eState::Locked};
+    Commands m_commands;
+};
+
+// Hierarchical timing wheel: Levels wheels of 64 slots, level k holding the
+// timers due within 64^(k+1) ticks. Timers live in a pool and are linked into
+// their slot, so schedule and cancel are O(1); advancing moves the timers of
+// a higher slot down when a lower wheel wraps, and hands every timer of the
+// current tick to the caller in one batch. Driven by a single thread.
+class TimerWheel
 {
-    m_state = eState::Locked;
-    m_pos.setRows("Touch Card");
-    m_door.close();
-    m_led.setStatus(LEDPattern::RedCross);
-}
+    static constexpr unsigned SlotBits = 6;
+    static constexpr size_t Slots = 1 << SlotBits;
+    static constexpr size_t Levels = 4;
+    static constexpr uint32_t None = UINT32_MAX;
+
+public:
+    // range of the top wheel: a later timer keeps its real expiry but is parked in
+    // the last slot reachable from now, then re-filed each time that slot is reached
+    static constexpr uint64_t MaxDelay = (uint64_t{1} << (SlotBits * Levels)) - 1;
 
-void FSM::transitionToPaymentSuccessful(int fare, int balance)
+    struct TimerId
+    {
+        uint32_t index{None};
+        uint32_t generation{0};
+    };
+
+    // timers due after delay ticks (at least 1), token given back on expiry
+    TimerId schedule(uint64_t delay, uint32_t token)
+    {
+        auto index = m_free;
+        if (index == None)
+        {
+            index = static_cast<uint32_t>(m_timers.size());
+            m_timers.emplace_back();
+        }
+        else
+        {
+            m_free = m_timers[index].next;
+        }
+
+        auto& timer = m_timers[index];
+        timer.expiry = m_now + std::max<uint64_t>(delay, 1);
+        timer.token = token;
+        file(index);
+        ++m_active;
+        return {index, timer.generation};
+    }
+
+    // false if the timer already expired or was cancelled
+    bool cancel(TimerId id)
+    {
+        if (id.index >= m_timers.size() || m_timers[id.index].generation != id.generation
+            || m_timers[id.index].level == Unlinked)
+        {
+            return false;
+        }
+        unlink(id.index);
+        release(id.index);
+        return true;
+    }
+
+    // moves time forward by ticks, expire(token) for every timer due meanwhile;
+    // returns the number of expired timers
+    template <typename Func>
+    size_t advance(uint64_t ticks, Func&& expire)
+    {
+        size_t expired = 0;
+        auto target = m_now + ticks;
+        while (m_now < target)
+        {
+            // nothing due on the lowest wheel: jump to its next wrap
+            if (m_occupied[0] == 0)
+            {
+                auto wrap = (m_now | (Slots - 1)) + 1;
+                if (wrap > target)
+                {
+                    m_now = target;
+                    break;
+                }
+                m_now = wrap;
+            }
+            else
+            {
+                ++m_now;
+            }
+
+            // a wheel wraps: pull the next slot of the wheel above down, cascading up
+            for (size_t level = 1; level < Levels && (m_now & ((uint64_t{1} << (SlotBits * level)) - 1)) == 0; ++level)
+            {
+                cascade(level, (m_now >> (SlotBits * level)) & (Slots - 1));
+            }
+
+            auto slot = m_now & (Slots - 1);
+            auto index = m_heads[0][slot];
+            m_heads[0][slot] = None;
+            m_occupied[0] &= ~(uint64_t{1} << slot);
+            while (index != None)
+            {
+                auto next = m_timers[index].next;
+                auto token = m_timers[index].token;
+                m_timers[index].level = Unlinked;
+                release(index);
+                expire(token);
+                ++expired;
+                index = next;
+            }
+        }
+        return expired;
+    }
+
+    uint64_t now() const { return m_now; }
+    size_t active() const { return m_active; }
+
+private:
+    static constexpr uint8_t Unlinked = UINT8_MAX;
+
+    struct Timer
+    {
+        uint64_t expiry{0};
+        uint32_t token{0};
+        uint32_t generation{0};
+        uint32_t prev{None};
+        uint32_t next{None};
+        uint8_t level{Unlinked};
+        uint8_t slot{0};
+    };
+
+    void file(uint32_t index)
+    {
+        auto& timer = m_timers[index];
+        auto delta = timer.expiry > m_now ? timer.expiry - m_now : 0;
+        size_t level = 0;
+        while (level + 1 < Levels && delta >= (uint64_t{1} << (SlotBits * (level + 1))))
+        {
+            ++level;
+        }
+        // beyond MaxDelay: the top slot cascaded last, before the expiry
+        auto at = std::min(timer.expiry, m_now + MaxDelay);
+        auto slot = (at >> (SlotBits * level)) & (Slots - 1);
+
+        timer.level = static_cast<uint8_t>(level);
+        timer.slot = static_cast<uint8_t>(slot);
+        timer.prev = None;
+        timer.next = m_heads[level][slot];
+        if (timer.next != None)
+        {
+            m_timers[timer.next].prev = index;
+        }
+        m_heads[level][slot] = index;
+        m_occupied[level] |= uint64_t{1} << slot;
+    }
+
+    void unlink(uint32_t index)
+    {
+        auto& timer = m_timers[index];
+        if (timer.prev != None)
+        {
+            m_timers[timer.prev].next = timer.next;
+        }
+        else
+        {
+            m_heads[timer.level][timer.slot] = timer.next;
+            if (timer.next == None)
+            {
+                m_occupied[timer.level] &= ~(uint64_t{1} << timer.slot);
+            }
+        }
+        if (timer.next != None)
+        {
+            m_timers[timer.next].prev = timer.prev;
+        }
+        timer.level = Unlinked;
+    }
+
+    void release(uint32_t index)
+    {
+        auto& timer = m_timers[index];
+        ++timer.generation;
+        timer.next = m_free;
+        m_free = index;
+        --m_active;
+    }
+
+    void cascade(size_t level, size_t slot)
+    {
+        auto index = m_heads[level][slot];
+        m_heads[level][slot] = None;
+        m_occupied[level] &= ~(uint64_t{1} << slot);
+        while (index != None)
+        {
+            auto next = m_timers[index].next;
+            file(index);
+            index = next;
+        }
+    }
+
+    std::vector<Timer> m_timers;
+    uint32_t m_free{None};
+    size_t m_active{0};
+    uint64_t m_now{0};
+    std::array<std::array<uint32_t, Slots>, Levels> m_heads = []
+    {
+        std::array<std::array<uint32_t, Slots>, Levels> heads;
+        for (auto& level : heads) level.fill(None);
+        return heads;
+    }();
+    std::array<uint64_t, Levels> m_occupied{};
+};
+
+// Thousands of turnstiles driven by one thread: events are queued with the
+// index of their turnstile and drained in arrival order, then the I/O stage
+// flushes the device commands they produced. The queue keeps its capacity,
+// so a steady stream of events does not allocate.
+// A state with a timeout arms one timer per turnstile on entry; leaving the
+// state cancels it, and a Timeout already queued for an old state is dropped.
+class TurnstileBank
 {
-    m_state = eState::PaymentSuccess;
-    std::string reason = "Fare: " + std::to_string(fare) + ", balance: " + std::to_string(balance);
-    m_pos.setRows("Approved", reason);
-    m_door.open();
-    m_led.setStatus(LEDPattern::GreenArrow);
-}
+public:
+    // ticks before a Timeout per state, 0 for none
+    static constexpr std::array<uint64_t, StateCount> TimeoutTicks
+    {
+        0,      // Locked
+        3000,   // PaymentProcessing: network timeout
+        2000,   // PaymentFailed: show the error, then lock
+        1000,   // PaymentSuccess: approved screen, then Unlocked
+        0,      // Unlocked
+    };
+
+    TurnstileBank(size_t count, std::ostream& out)
+        : m_turnstiles(count), m_timers(count), m_arms(count, 0)
+    {
+        m_devices.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_devices.emplace_back(out);
+        }
+    }
+
+    void post(uint32_t turnstile, const Event& event) { m_queue.push_back({turnstile, 0, event}); }
+
+    // moves the wheel forward, queues a Timeout for every timer due
+    size_t tick(uint64_t ticks = 1)
+    {
+        return m_wheel.advance(ticks, [this](uint32_t turnstile)
+        {
+            m_timers[turnstile] = {};
+            m_queue.push_back({turnstile, m_arms[turnstile], Timeout()});
+        });
+    }
+
+    // processes every queued event, returns how many
+    size_t run()
+    {
+        for (const auto& [turnstile, arm, event] : m_queue)
+        {
+            if (arm != 0 && arm != m_arms[turnstile])
+            {
+                ++m_stale;
+                continue;
+            }
+
+            auto& fsm = m_turnstiles[turnstile];
+            auto before = fsm.getState();
+            fsm.process(event);
+            if (fsm.getState() != before)
+            {
+                rearm(turnstile, fsm.getState());
+            }
+        }
+        auto processed = m_queue.size();
+        m_queue.clear();
+        return processed;
+    }
 
-void FSM::transitionToUnlocked()
+    // I/O stage: writes the pending device commands of every turnstile
+    void flush()
+    {
+        for (size_t i = 0; i < m_turnstiles.size(); ++i)
+        {
+            if (!m_turnstiles[i].commands().empty())
+            {
+                m_devices[i].flush(m_turnstiles[i].commands());
+            }
+        }
+    }
+
+    FSM& operator[](size_t turnstile) { return m_turnstiles[turnstile]; }
+    const DeviceIO& devices(size_t turnstile) const { return m_devices[turnstile]; }
+    const TimerWheel& wheel() const { return m_wheel; }
+    size_t stale() const { return m_stale; }
+    size_t size() const { return m_turnstiles.size(); }
+
+private:
+    struct Queued
+    {
+        uint32_t turnstile;
+        uint32_t arm;       // arm count of the timer for a Timeout, 0 for external events
+        Event event;
+    };
+
+    void rearm(uint32_t turnstile, eState state)
+    {
+        m_wheel.cancel(m_timers[turnstile]);
+        m_timers[turnstile] = {};
+        if (++m_arms[turnstile] == 0) ++m_arms[turnstile];
+
+        auto ticks = TimeoutTicks[static_cast<size_t>(state)];
+        if (ticks != 0)
+        {
+            m_timers[turnstile] = m_wheel.schedule(ticks, turnstile);
+        }
+    }
+
+    std::vector<FSM> m_turnstiles;
+    std::vector<DeviceIO> m_devices;
+    std::vector<Queued> m_queue;
+    TimerWheel m_wheel;
+    std::vector<TimerWheel::TimerId> m_timers;
+    std::vector<uint32_t> m_arms;
+    size_t m_stale{0};
+};
+
+bool verifyWheel()
 {
-    m_state = eState::Unlocked;
-    m_door.open();
-    m_pos.setRows("Approved");
-    m_led.setStatus(LEDPattern::GreenArrow);
+    // random schedules and cancels against the expected expiry tick of each timer
+    TimerWheel wheel;
+    std::mt19937_64 gen(9);
+    std::uniform_int_distribution<uint64_t> delay(1, 300'000);
+    std::uniform_int_distribution<uint64_t> step(1, 5'000);
+    std::vector<uint64_t> due;
+    std::vector<TimerWheel::TimerId> ids;
+    size_t expired = 0, cancelled = 0;
+    bool ok = true;
+
+    for (int round = 0; round < 2'000; ++round)
+    {
+        for (int i = 0; i < 20; ++i)
+        {
+            auto d = delay(gen);
+            due.push_back(wheel.now() + d);
+            ids.push_back(wheel.schedule(d, static_cast<uint32_t>(due.size() - 1)));
+        }
+        auto victim = gen() % ids.size();
+        if (wheel.cancel(ids[victim]))
+        {
+            due[victim] = 0;
+            ++cancelled;
+        }
+        expired += wheel.advance(step(gen), [&](uint32_t token)
+        {
+            if (due[token] != wheel.now())
+            {
+                ok = false;
+            }
+            due[token] = 0;
+        });
+    }
+    expired += wheel.advance(TimerWheel::MaxDelay, [&](uint32_t token)
+    {
+        ok = ok && due[token] == wheel.now();
+        due[token] = 0;
+    });
+
+    ok = ok && wheel.active() == 0 && expired + cancelled == due.size()
+            && std::all_of(due.begin(), due.end(), [](uint64_t d) { return d == 0; });
+
+    // delays past the top wheel fire on their exact tick, after being parked
+    // and re-filed, whether time moves in large or small steps
+    for (uint64_t stride : {TimerWheel::MaxDelay, uint64_t{4'099'999}})
+    {
+        TimerWheel far;
+        far.advance(777, [](uint32_t) {});
+        const uint64_t delays[] = {3 * TimerWheel::MaxDelay, TimerWheel::MaxDelay + 1, 2 * TimerWheel::MaxDelay + 12'345, 5 * TimerWheel::MaxDelay};
+        std::vector<uint64_t> fired(std::size(delays), 0);
+        TimerWheel::TimerId last;
+        for (uint32_t i = 0; i < std::size(delays); ++i)
+        {
+            last = far.schedule(delays[i], i);
+        }
+        auto record = [&](uint32_t token) { fired[token] = far.now(); };
+        far.advance(TimerWheel::MaxDelay, record);
+        ok = ok && far.cancel(last);
+        while (far.active() != 0)
+        {
+            far.advance(stride, record);
+        }
+        for (size_t i = 0; i + 1 < std::size(delays); ++i)
+        {
+            ok = ok && fired[i] == 777 + delays[i];
+        }
+        ok = ok && fired.back() == 0;
+    }
+    if (!ok)
+    {
+        std::cout << "timer wheel mismatch\n";
+    }
+    return ok;
 }
 
-FSM &FSM::process(Timeout event)
+void benchmark()
 {
-    switch (m_state)
-    {
-    case eState::PaymentProcessing:
-        m_door.close();
-        m_pos.setRows("Network error");
-        m_led.setStatus(LEDPattern::FlashRedCross);
-        m_state = eState::PaymentFailed;
-        break;
-
-    case eState::PaymentFailed:
-        transitionToLocked();
-        break;
-    case eState::PaymentSuccess:
-        transitionToUnlocked();
-        break;
-    default:
-        break;
-    }
-    return *this;
+    constexpr size_t Turnstiles = 10'000;
+    constexpr size_t EventsPerRound = 1'000'000;
+    constexpr int Rounds = 10;
+    constexpr size_t EventsPerTick = 10;     // one event per turnstile every 1000 ticks on average
+    constexpr size_t TicksPerFlush = 100;
+
+    // devices write into a stream without buffer: the cost of the engine, not of the console
+    std::ostream silent(nullptr);
+    TurnstileBank bank(Turnstiles, silent);
+
+    // Timeout comes from the timer wheel only
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> turnstile(0, Turnstiles - 1);
+    std::uniform_int_distribution<size_t> kind(0, std::variant_size_v<Event> - 2);
+    std::vector<std::pair<uint32_t, Event>> events;
+    events.reserve(EventsPerRound);
+    for (size_t i = 0; i < EventsPerRound; ++i)
+    {
+        Event event = CardPresented();
+        switch (kind(gen))
+        {
+            case 1: event = TransactionDeclined(); break;
+            case 2: event = TransactionSuccess(5, static_cast<int>(i % 1000)); break;
+            case 3: event = PersonPassed(); break;
+        }
+        events.emplace_back(turnstile(gen), event);
+    }
+
+    size_t processed = 0, timeouts = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int round = 0; round < Rounds; ++round)
+    {
+        for (size_t i = 0; i < events.size(); i += EventsPerTick)
+        {
+            for (size_t k = i; k < std::min(i + EventsPerTick, events.size()); ++k)
+            {
+                bank.post(events[k].first, events[k].second);
+            }
+            timeouts += bank.tick();
+            processed += bank.run();
+            if (bank.wheel().now() % TicksPerFlush == 0)
+            {
+                bank.flush();
+            }
+        }
+    }
+    bank.flush();
+    auto end = std::chrono::steady_clock::now();
+
+    size_t unlocked = 0, queued = 0, written = 0, superseded = 0;
+    for (size_t i = 0; i < bank.size(); ++i)
+    {
+        unlocked += bank[i].getState() != eState::Locked;
+        queued += bank.devices(i).queued();
+        written += bank.devices(i).written();
+        superseded += bank[i].commands().superseded();
+    }
+    auto seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "engine: " << processed / seconds / 1e6 << " M events/s over " << Turnstiles
+              << " turnstiles (" << unlocked << " not locked)\n";
+    std::cout << "device commands: " << queued << " queued, " << written << " written, "
+              << superseded << " superseded in the rings\n";
+    std::cout << "timer wheel: " << bank.wheel().now() << " ticks, " << timeouts << " timeouts fired, "
+              << bank.stale() << " stale, " << bank.wheel().active() << " armed\n";
+
+    // raw wheel cost: schedule then cancel, and schedule then expire
+    TimerWheel wheel;
+    std::vector<TimerWheel::TimerId> ids(EventsPerRound);
+    std::uniform_int_distribution<uint64_t> delay(1, 10'000);
+    std::vector<uint64_t> delays(EventsPerRound);
+    for (auto& d : delays) d = delay(gen);
+
+    begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < EventsPerRound; ++i) ids[i] = wheel.schedule(delays[i], static_cast<uint32_t>(i));
+    for (size_t i = 0; i < EventsPerRound; ++i) wheel.cancel(ids[i]);
+    auto middle = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < EventsPerRound; ++i) wheel.schedule(delays[i], static_cast<uint32_t>(i));
+    size_t fired = wheel.advance(10'000, [](uint32_t) {});
+    end = std::chrono::steady_clock::now();
+
+    std::cout << "timer wheel: schedule+cancel " << std::chrono::duration<double, std::nano>(middle - begin).count() / EventsPerRound
+              << " ns, schedule+expire " << std::chrono::duration<double, std::nano>(end - middle).count() / fired << " ns\n";
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+    static_assert(fsm::variant_index<Timeout, Event>::value == 4);
+
     auto fsm = FSM();
+    DeviceIO io(std::cout);
+    io.flush(fsm.commands());
+    std::cout << "System was boot OK with state Locked\n";
+
     fsm.process(CardPresented())
     .process(TransactionSuccess(5, 100));
-    // std::cout<<"test "<<test<<"\n";
+    io.flush(fsm.commands());
+    std::cout << "state " << fsm.getState() << "\n";
+
+    // door stays open and the LED green from PaymentSuccess to Unlocked: coalesced
+    fsm.process(Timeout()).process(PersonPassed()).process(CardPresented()).process(Timeout());
+    io.flush(fsm.commands());
+    std::cout << "state " << fsm.getState() << ", " << io.written() << " of " << io.queued() << " device commands written\n";
+
+    // Timeout from the timer wheel: network error after 3000 ticks, locked 2000 later
+    std::ostream silent(nullptr);
+    TurnstileBank bank(1, silent);
+    bank.post(0, CardPresented());
+    bank.run();
+    for (uint64_t elapsed = 0; elapsed < 6000; elapsed += 500)
+    {
+        bank.tick(500);
+        bank.run();
+        std::cout << "after " << bank.wheel().now() << " ticks: " << bank[0].getState() << "\n";
+    }
+    // rows outlive the text they were set from, long text is truncated
+    POSTerminal pos(silent, "");
+    pos.setRows("Approved", std::string("Fare: ") + std::to_string(5));
+    pos.setRows(pos.getFirstRow(), pos.getSecondRow(), POSTerminal::Row::format("Balance after a very long trip: ", 123456789));
+    if (pos.getSecondRow() != "Fare: 5" || pos.getThirdRow() != "Balance after a very long trip: ")
+    {
+        std::cout << "screen rows mismatch\n";
+        return 1;
+    }
+
+    if (!verifyWheel())
+    {
+        return 1;
+    }
+
+    if (argc > 1 && std::string_view(argv[1]) == "bench")
+    {
+        benchmark();
+    }
     return 0;
 }
@@ -1,20 +1,137 @@
 #include <map>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <span>
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <thread>
+#include <functional>
+#include <set>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <tuple>
+#include <queue>
+#include <limits>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+namespace interval_detail {
+    // only operator< is required from K
+    template<typename K>
+    bool equal(K const& a, K const& b) { return !(a < b) && !(b < a); }
+
+    // Resolve a batch of assigns applied in order (later ones win where they overlap)
+    // into disjoint segments sorted by key. O(m log m) sweep over the boundaries.
+    template<typename K, typename V>
+    std::vector<std::tuple<K, K, V>> resolveUpdates(std::span<std::tuple<K, K, V> const> updates) {
+        struct Boundary {
+            K key;
+            size_t seq;
+            bool begin;
+        };
+        std::vector<Boundary> boundaries;
+        boundaries.reserve(updates.size() * 2);
+        for (size_t seq = 0; seq < updates.size(); ++seq) {
+            auto const& [keyBegin, keyEnd, val] = updates[seq];
+            if (!(keyBegin < keyEnd)) continue; // Empty range, do nothing
+            boundaries.push_back({keyBegin, seq, true});
+            boundaries.push_back({keyEnd, seq, false});
+        }
+        std::sort(boundaries.begin(), boundaries.end(), [](auto const& a, auto const& b) { return a.key < b.key; });
+
+        std::vector<std::tuple<K, K, V>> segments;
+        std::priority_queue<size_t> active;   // newest update covering the sweep position
+        std::vector<bool> ended(updates.size());
+        for (size_t i = 0; i < boundaries.size();) {
+            auto const& key = boundaries[i].key;
+            for (; i < boundaries.size() && equal(boundaries[i].key, key); ++i) {
+                if (boundaries[i].begin) active.push(boundaries[i].seq);
+                else ended[boundaries[i].seq] = true;
+            }
+            while (!active.empty() && ended[active.top()]) active.pop(); // lazy deletion
+            if (active.empty() || i == boundaries.size()) continue;
+
+            auto const& val = std::get<2>(updates[active.top()]);
+            auto const& next = boundaries[i].key;
+            if (!segments.empty() && equal(std::get<1>(segments.back()), key) && std::get<2>(segments.back()) == val) {
+                std::get<1>(segments.back()) = next; // coalesce with the previous segment
+            } else {
+                segments.emplace_back(key, next, val);
+            }
+        }
+        return segments;
+    }
+
+    // One linear pass merging canonical breakpoints (key, value) with disjoint sorted
+    // segments that overwrite them. emit(key, value) receives the new canonical
+    // breakpoints in key order: no two consecutive values equal, the first differs from valBegin.
+    // The base is walked as [first, last) with keyOf(it)/valOf(it) projections, so
+    // std::map iterators and indices into parallel vectors both work.
+    template<typename K, typename V, typename It, typename KeyOf, typename ValOf, typename Emit>
+    void mergeBreakpoints(V const& valBegin, It first, It last, KeyOf keyOf, ValOf valOf,
+                          std::vector<std::tuple<K, K, V>> const& segments, Emit&& emit) {
+        auto itBase = first;
+        size_t seg = 0;
+        V const* baseVal = &valBegin;       // value of base at the sweep position
+        V const* lastVal = &valBegin;       // last emitted value
+
+        auto emitIfChanged = [&](K const& key, V const& val) {
+            if (!(val == *lastVal)) {
+                emit(key, val);
+                lastVal = &val;
+            }
+        };
+
+        bool inside = false;                // sweep position is inside segments[seg]
+        while (itBase != last || seg < segments.size()) {
+            // next key where either input changes
+            K const* key = itBase != last ? &keyOf(itBase) : nullptr;
+            if (seg < segments.size()) {
+                K const& boundary = inside ? std::get<1>(segments[seg]) : std::get<0>(segments[seg]);
+                if (!key || boundary < *key) key = &boundary;
+            }
+            K const current = *key;
+
+            while (itBase != last && equal(keyOf(itBase), current)) {
+                baseVal = &valOf(itBase);
+                ++itBase;
+            }
+            while (seg < segments.size() && !(current < std::get<1>(segments[seg]))) ++seg;
+            inside = seg < segments.size() && !(current < std::get<0>(segments[seg]));
+
+            emitIfChanged(current, inside ? std::get<2>(segments[seg]) : *baseVal);
+        }
+    }
+}
 
 template<typename K, typename V>
 class interval_map {
     friend void IntervalMapTest();
     V m_valBegin;
     std::map<K,V> m_map;
+    uint64_t m_version{0};  // bumped by every assign, lets derived indexes detect they are stale
 
 public:
     // constructor associates whole range of K with val
+    // the lowest-key sentinel lets assign() always take std::prev of a lower_bound
     template<typename V_forward>
     interval_map(V_forward&& val)
-    : m_valBegin(std::forward<V_forward>(val)) {}
+    : m_valBegin(std::forward<V_forward>(val)) {
+        m_map.insert(m_map.end(), std::make_pair(std::numeric_limits<K>::lowest(), m_valBegin));
+    }
 
     // Assign value val to interval [keyBegin, keyEnd).
     // Overwrite previous values in this interval.
@@ -22,13 +139,8 @@ public:
     void assign(K const& keyBegin, K const& keyEnd, V_forward&& val)
         requires (std::is_same<std::remove_cvref_t<V_forward>, V>::value)
     {
-        std::once_flag flag;
-        std::call_once(flag, [&]()
-        {
-            m_map.insert(m_map.end(), std::make_pair(std::numeric_limits<K>::lowest(), m_valBegin));
-        });
-
         if (!(keyBegin < keyEnd)) return; // Empty range, do nothing
+        ++m_version;
 
         // Step 1: Adjust the interval map to start at keyBegin
         auto itLow = m_map.lower_bound(keyBegin);
@@ -51,6 +163,41 @@ public:
         itLow->second = val;
     }
 
+    // Apply many assigns at once, in order (later ones win where they overlap).
+    // The updates are sorted and resolved to disjoint segments, which are then
+    // spliced in with a single forward cursor over the breakpoints: every insert
+    // is hinted and no key is searched from the root twice.
+    void assign_bulk(std::span<std::tuple<K, K, V> const> updates) {
+        auto segments = interval_detail::resolveUpdates<K, V>(updates);
+        if (!segments.empty()) ++m_version;
+
+        auto it = m_map.begin();
+        for (auto const& [keyBegin, keyEnd, val] : segments) {
+            it = seek(it, keyBegin);   // first breakpoint >= keyBegin
+            V before = it == m_map.begin() ? m_valBegin : std::prev(it)->second;
+
+            auto itEnd = seek(it, keyEnd);
+            bool endExists = itEnd != m_map.end() && interval_detail::equal(itEnd->first, keyEnd);
+            // value resuming at keyEnd, before anything is erased
+            V after = endExists ? itEnd->second
+                    : itEnd == m_map.begin() ? m_valBegin : std::prev(itEnd)->second;
+
+            it = m_map.erase(it, itEnd);
+            if (!endExists && !(after == val)) {
+                it = m_map.emplace_hint(it, keyEnd, std::move(after));
+            } else if (endExists && after == val) {
+                it = m_map.erase(it);   // breakpoint at keyEnd became redundant
+            }
+            // the sentinel must survive even when it is redundant
+            if (!(before == val) || it == m_map.begin()) {
+                m_map.emplace_hint(it, keyBegin, val);
+            }
+        }
+    }
+
+    // changes whenever an assign changes (or may have changed) the map
+    uint64_t version() const { return m_version; }
+
     // look-up of the value associated with key
     V const& operator[](K const& key) const {
         auto it = m_map.upper_bound(key);
@@ -61,12 +208,832 @@ public:
         }
     }
 
+    // Look up a batch of keys sorted ascending: one merge walk over the breakpoints,
+    // short gaps are stepped through and long ones are skipped with upper_bound.
+    void lookup_sorted(std::span<K const> keys, std::span<V> out) const {
+        constexpr int MaxSteps = 8;
+
+        auto it = m_map.begin();   // first breakpoint > the previous key
+        for (size_t i = 0; i < keys.size(); ++i) {
+            int steps = 0;
+            while (it != m_map.end() && !(keys[i] < it->first) && steps++ < MaxSteps) ++it;
+            if (steps > MaxSteps) it = m_map.upper_bound(keys[i]);
+
+            out[i] = it == m_map.begin() ? m_valBegin : std::prev(it)->second;
+        }
+    }
+
+    // (begin, end, value) of one run of equal values, clipped to the query range
+    struct Segment {
+        K begin;
+        K end;
+        V const& value;
+    };
+
+    // Forward iterator over the segments overlapping [qBegin, qEnd). Holds two map
+    // iterators and the query bounds, nothing is allocated.
+    class segment_iterator {
+        friend class interval_map;
+        using map_iterator = typename std::map<K,V>::const_iterator;
+
+        map_iterator m_it;      // breakpoint starting the current segment
+        map_iterator m_next;    // first later breakpoint with a different value
+        map_iterator m_end;
+        K m_qBegin;
+        K m_qEnd;
+
+        segment_iterator(map_iterator it, map_iterator end, K const& qBegin, K const& qEnd)
+        : m_it(it), m_next(it), m_end(end), m_qBegin(qBegin), m_qEnd(qEnd) {
+            skipEqual();
+        }
+
+        // breakpoints repeating the previous value do not start a new segment
+        void skipEqual() {
+            if (m_it == m_end) return;
+            m_next = std::next(m_it);
+            while (m_next != m_end && m_next->first < m_qEnd && m_next->second == m_it->second) ++m_next;
+        }
+
+    public:
+        Segment operator*() const {
+            K const& begin = m_it->first < m_qBegin ? m_qBegin : m_it->first;
+            K const& end = m_next != m_end && m_next->first < m_qEnd ? m_next->first : m_qEnd;
+            return {begin, end, m_it->second};
+        }
+
+        segment_iterator& operator++() {
+            m_it = m_next;
+            if (m_it != m_end && !(m_it->first < m_qEnd)) m_it = m_end;
+            skipEqual();
+            return *this;
+        }
+
+        bool operator==(segment_iterator const& other) const { return m_it == other.m_it; }
+    };
+
+    struct segment_range {
+        segment_iterator first;
+        segment_iterator last;
+        segment_iterator begin() const { return first; }
+        segment_iterator end() const { return last; }
+    };
+
+    // all segments overlapping [qBegin, qEnd), e.g.
+    //      for (auto [begin, end, value] : map.segments(0, 100)) ...
+    segment_range segments(K const& qBegin, K const& qEnd) const {
+        auto it = m_map.end();
+        if (qBegin < qEnd) {
+            it = m_map.upper_bound(qBegin);
+            --it;   // the lowest-key sentinel makes this always valid
+        }
+        return {segment_iterator(it, m_map.end(), qBegin, qEnd), segment_iterator(m_map.end(), m_map.end(), qBegin, qEnd)};
+    }
+
+    // Write the map in the format read by mapped_interval_map (see there)
+    void save(std::string const& path) const
+        requires (std::is_integral_v<K> && std::is_trivially_copyable_v<V>);
+
     void print() const {
         for (auto&& [key, val] : m_map) {
             std::cout << "[" << key << ':' << val << "]";
         }
         std::cout << '\n';
     }
+
+private:
+    // lower_bound(key) for a key not below it->first: a few steps forward, then a tree search
+    typename std::map<K,V>::iterator seek(typename std::map<K,V>::iterator it, K const& key) {
+        for (int steps = 0; steps < 8; ++steps) {
+            if (it == m_map.end() || !(it->first < key)) return it;
+            ++it;
+        }
+        return m_map.lower_bound(key);
+    }
+};
+
+// Compact on-disk interval_map, read back through mmap without deserializing.
+// Layout (native endianness, sections 8-byte aligned):
+//   header
+//   K        blockKeys[blockCount]     first key of every block of BlockSize breakpoints
+//   uint64_t blockOffsets[blockCount]  where the block's deltas start in the delta stream
+//   uint8_t  deltas[]                  LEB128 varint of key[i] - key[i-1] inside a block
+//   V        dictionary[dictCount]     distinct values
+//   uint8_t  indices[count * width]    dictionary index per breakpoint, 1/2/4 bytes wide
+// A lookup binary searches blockKeys, then decodes at most one block of deltas.
+namespace interval_file {
+    constexpr size_t BlockSize = 64;
+    constexpr char Magic[8] = {'I', 'V', 'M', 'A', 'P', '0', '1', '\0'};
+
+    struct Header {
+        char magic[8];
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint64_t count;
+        uint64_t blockCount;
+        uint64_t dictCount;
+        uint32_t indexWidth;
+        uint32_t valBeginIndex;
+        uint64_t blockKeysOffset;
+        uint64_t blockOffsetsOffset;
+        uint64_t deltasOffset;
+        uint64_t dictOffset;
+        uint64_t indicesOffset;
+        uint64_t fileSize;
+    };
+
+    inline uint64_t align(uint64_t offset) { return (offset + 7) & ~uint64_t{7}; }
+
+    inline void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // throws std::runtime_error rather than read past end
+    inline uint64_t getVarint(uint8_t const*& in, uint8_t const* end) {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            if (in == end || shift > 63) throw std::runtime_error("Corrupt interval_map file: bad delta");
+            uint8_t byte = *in++;
+            value |= uint64_t{byte & 0x7fu} << shift;
+            if (!(byte & 0x80)) return value;
+        }
+    }
+}
+
+template<typename K, typename V>
+void interval_map<K, V>::save(std::string const& path) const
+    requires (std::is_integral_v<K> && std::is_trivially_copyable_v<V>)
+{
+    using namespace interval_file;
+    using U = std::make_unsigned_t<K>;
+
+    // canonical breakpoints: drop the sentinel and repeated values
+    std::vector<K> keys;
+    std::vector<uint32_t> indices;
+    std::vector<V> dictionary;
+    std::map<std::vector<char>, uint32_t> dictIndex;    // by raw bytes, V needs no operator<
+    auto indexOf = [&](V const& val) {
+        std::vector<char> bytes(sizeof(V));
+        std::memcpy(bytes.data(), &val, sizeof(V));
+        auto [it, inserted] = dictIndex.try_emplace(bytes, static_cast<uint32_t>(dictionary.size()));
+        if (inserted) dictionary.push_back(val);
+        return it->second;
+    };
+    uint32_t valBeginIndex = indexOf(m_valBegin);
+    V const* last = &m_valBegin;
+    for (auto const& [key, val] : m_map) {
+        if (val == *last) continue;
+        keys.push_back(key);
+        indices.push_back(indexOf(val));
+        last = &val;
+    }
+
+    Header header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.keySize = sizeof(K);
+    header.valueSize = sizeof(V);
+    header.count = keys.size();
+    header.blockCount = (keys.size() + BlockSize - 1) / BlockSize;
+    header.dictCount = dictionary.size();
+    header.indexWidth = dictionary.size() <= 0x100 ? 1 : dictionary.size() <= 0x10000 ? 2 : 4;
+    header.valBeginIndex = valBeginIndex;
+
+    std::vector<K> blockKeys;
+    std::vector<uint64_t> blockOffsets;
+    std::vector<uint8_t> deltas;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i % BlockSize == 0) {
+            blockKeys.push_back(keys[i]);
+            blockOffsets.push_back(deltas.size());
+        } else {
+            putVarint(deltas, static_cast<U>(keys[i]) - static_cast<U>(keys[i - 1]));
+        }
+    }
+
+    header.blockKeysOffset = align(sizeof(Header));
+    header.blockOffsetsOffset = align(header.blockKeysOffset + blockKeys.size() * sizeof(K));
+    header.deltasOffset = align(header.blockOffsetsOffset + blockOffsets.size() * sizeof(uint64_t));
+    header.dictOffset = align(header.deltasOffset + deltas.size());
+    header.indicesOffset = align(header.dictOffset + dictionary.size() * sizeof(V));
+    header.fileSize = header.indicesOffset + keys.size() * header.indexWidth;
+
+    // written aside then renamed over path: a reader still mapping the old file
+    // keeps a complete one, a crash leaves either the old or the new file
+    auto temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot open " + temporary);
+    bool ok = true;
+    auto write = [&](uint64_t offset, void const* data, size_t size) {
+        auto bytes = static_cast<char const*>(data);
+        while (ok && size > 0) {
+            auto n = ::pwrite(fd, bytes, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            ok = n > 0;
+            if (ok) {
+                bytes += n;
+                offset += static_cast<uint64_t>(n);
+                size -= static_cast<size_t>(n);
+            }
+        }
+    };
+    std::vector<uint8_t> packed(indices.size() * header.indexWidth);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        std::memcpy(packed.data() + i * header.indexWidth, &indices[i], header.indexWidth); // little endian
+    }
+    write(0, &header, sizeof(header));
+    write(header.blockKeysOffset, blockKeys.data(), blockKeys.size() * sizeof(K));
+    write(header.blockOffsetsOffset, blockOffsets.data(), blockOffsets.size() * sizeof(uint64_t));
+    write(header.deltasOffset, deltas.data(), deltas.size());
+    write(header.dictOffset, dictionary.data(), dictionary.size() * sizeof(V));
+    write(header.indicesOffset, packed.data(), packed.size());
+    ok = ok && ::ftruncate(fd, static_cast<off_t>(header.fileSize)) == 0 && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || ::rename(temporary.c_str(), path.c_str()) != 0) {
+        ::unlink(temporary.c_str());
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+// Read-only interval_map over a file written by interval_map::save(). The file is
+// mmap'd, nothing is parsed up front: opening costs a header check and lookups
+// fault in only the pages they touch. Values are returned straight from the mapping.
+// Opening validates the header and block index, so a corrupt file throws
+// std::runtime_error instead of sending lookups outside the mapping.
+template<typename K, typename V>
+class mapped_interval_map {
+    using U = std::make_unsigned_t<K>;
+
+    void* m_data{nullptr};
+    size_t m_size{0};
+    interval_file::Header const* m_header{nullptr};
+    K const* m_blockKeys{nullptr};
+    uint64_t const* m_blockOffsets{nullptr};
+    uint8_t const* m_deltas{nullptr};
+    uint8_t const* m_deltasEnd{nullptr};
+    V const* m_dictionary{nullptr};
+    uint8_t const* m_indices{nullptr};
+
+public:
+    explicit mapped_interval_map(std::string const& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open " + path);
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(interval_file::Header))) {
+            ::close(fd);
+            throw std::runtime_error("Not an interval_map file: " + path);
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (m_data == MAP_FAILED) throw std::runtime_error("Cannot mmap " + path);
+        ::madvise(m_data, m_size, MADV_RANDOM);  // lookups jump around, no readahead
+
+        auto base = static_cast<uint8_t const*>(m_data);
+        m_header = reinterpret_cast<interval_file::Header const*>(base);
+        if (std::memcmp(m_header->magic, interval_file::Magic, sizeof(interval_file::Magic)) != 0
+            || m_header->keySize != sizeof(K) || m_header->valueSize != sizeof(V)
+            || m_header->fileSize != m_size) {
+            ::munmap(m_data, m_size);
+            throw std::runtime_error("Not an interval_map file for these types: " + path);
+        }
+        if (!validSections(*m_header, m_size)) {
+            ::munmap(m_data, m_size);
+            throw std::runtime_error("Corrupt interval_map file: " + path);
+        }
+        m_blockKeys = reinterpret_cast<K const*>(base + m_header->blockKeysOffset);
+        m_blockOffsets = reinterpret_cast<uint64_t const*>(base + m_header->blockOffsetsOffset);
+        m_deltas = base + m_header->deltasOffset;
+        m_deltasEnd = base + m_header->dictOffset;
+        // the only per-block data lookups trust: where each block's deltas start
+        for (uint64_t b = 0; b < m_header->blockCount; ++b) {
+            if (m_blockOffsets[b] > m_header->dictOffset - m_header->deltasOffset
+                || (b > 0 && m_blockOffsets[b] < m_blockOffsets[b - 1])) {
+                ::munmap(m_data, m_size);
+                throw std::runtime_error("Corrupt interval_map file: " + path);
+            }
+        }
+        m_dictionary = reinterpret_cast<V const*>(base + m_header->dictOffset);
+        m_indices = base + m_header->indicesOffset;
+    }
+
+    mapped_interval_map(mapped_interval_map const&) = delete;
+    mapped_interval_map& operator=(mapped_interval_map const&) = delete;
+
+    ~mapped_interval_map() {
+        if (m_data) ::munmap(m_data, m_size);
+    }
+
+    // look-up of the value associated with key
+    V const& operator[](K const& key) const {
+        auto blocks = m_blockKeys + m_header->blockCount;
+        auto block = std::upper_bound(m_blockKeys, blocks, key);
+        if (block == m_blockKeys) return m_dictionary[m_header->valBeginIndex];
+        size_t b = static_cast<size_t>(block - m_blockKeys) - 1;
+
+        // walk the block's deltas while the next key is still <= key
+        size_t i = b * interval_file::BlockSize;
+        size_t last = std::min<size_t>(i + interval_file::BlockSize, m_header->count) - 1;
+        U current = static_cast<U>(m_blockKeys[b]);
+        uint8_t const* in = m_deltas + m_blockOffsets[b];
+        while (i < last) {
+            U next = current + static_cast<U>(interval_file::getVarint(in, m_deltasEnd));
+            if (key < static_cast<K>(next)) break;
+            current = next;
+            ++i;
+        }
+        return m_dictionary[index(i)];
+    }
+
+    size_t size() const { return m_header->count; }
+    size_t fileSize() const { return m_size; }
+
+private:
+    // counts, widths and every section inside the file, in order and aligned for
+    // its type; overflow-safe since any field may be garbage
+    static bool validSections(interval_file::Header const& h, size_t size) {
+        using interval_file::BlockSize;
+        auto fits = [&](uint64_t offset, uint64_t count, uint64_t width, uint64_t end) {
+            return offset <= end && (width == 0 || count <= (end - offset) / width);
+        };
+        return (h.indexWidth == 1 || h.indexWidth == 2 || h.indexWidth == 4)
+            && h.dictCount > 0 && h.valBeginIndex < h.dictCount
+            && h.count <= size && h.blockCount == (h.count + BlockSize - 1) / BlockSize
+            && h.blockKeysOffset >= sizeof(interval_file::Header) && h.blockKeysOffset % alignof(K) == 0
+            && h.blockOffsetsOffset % alignof(uint64_t) == 0 && h.dictOffset % alignof(V) == 0
+            && fits(h.blockKeysOffset, h.blockCount, sizeof(K), h.blockOffsetsOffset)
+            && fits(h.blockOffsetsOffset, h.blockCount, sizeof(uint64_t), h.deltasOffset)
+            && h.deltasOffset <= h.dictOffset
+            && fits(h.dictOffset, h.dictCount, sizeof(V), h.indicesOffset)
+            && fits(h.indicesOffset, h.count, h.indexWidth, size);
+    }
+
+    uint32_t index(size_t i) const {
+        uint32_t value = 0;
+        std::memcpy(&value, m_indices + i * m_header->indexWidth, m_header->indexWidth); // little endian
+        if (value >= m_header->dictCount) throw std::runtime_error("Corrupt interval_map file: bad value index");
+        return value;
+    }
+};
+
+// Optional read-only index over a snapshot of an interval_map, answering range
+// aggregates in O(log n) instead of walking every breakpoint. It is not updated by
+// assigns: once the map changes, queries throw std::logic_error until the index is
+// rebuilt. The map must outlive the index.
+// Needs K to support subtraction (lengths) and V to support operator< (value dictionary).
+//  - distinct(a, b): number of distinct values over [a, b). Segments are numbered in
+//    key order and prev[i] is the previous segment with the same value; the answer is
+//    how many segments l..r have prev < l, counted on a persistent segment tree.
+//  - length(v, a, b): total length of [a, b) mapped to v, from per-value prefix sums.
+template<typename K, typename V>
+class interval_index {
+    struct TreeNode {
+        uint32_t left;
+        uint32_t right;
+        uint32_t count;
+    };
+
+    struct Run {
+        K begin;
+        K end;
+        K prefix;   // total length of the value's runs before this one
+    };
+
+    std::vector<K> m_begins;                    // segment begin keys, sorted
+    std::vector<TreeNode> m_nodes;              // [0] is the empty tree
+    std::vector<uint32_t> m_roots;              // m_roots[l]: segments i with prev[i] < l
+    std::map<V, std::vector<Run>> m_runs;
+    interval_map<K, V> const& m_map;
+    uint64_t m_version;                         // of m_map when indexed
+
+public:
+    // indexes [keyBegin, keyEnd) of the map
+    interval_index(interval_map<K, V> const& map, K const& keyBegin, K const& keyEnd)
+    : m_map(map), m_version(map.version()) {
+        std::vector<uint32_t> prevPlusOne;  // prev[i] + 1, 0 when there is none
+        std::map<V, uint32_t> lastSeen;
+        for (auto [begin, end, value] : map.segments(keyBegin, keyEnd)) {
+            auto i = static_cast<uint32_t>(m_begins.size());
+            m_begins.push_back(begin);
+
+            auto [seen, inserted] = lastSeen.try_emplace(value, i + 1);
+            prevPlusOne.push_back(inserted ? 0 : seen->second);
+            seen->second = i + 1;
+
+            auto& runs = m_runs[value];
+            K prefix = runs.empty() ? K{} : runs.back().prefix + (runs.back().end - runs.back().begin);
+            runs.push_back({begin, end, prefix});
+        }
+
+        // version l holds every segment with prev[i] + 1 <= l, i.e. prev[i] < l
+        size_t n = m_begins.size();
+        std::vector<std::vector<uint32_t>> byPrev(n + 1);
+        for (uint32_t i = 0; i < n; ++i) byPrev[prevPlusOne[i]].push_back(i);
+
+        m_nodes.push_back({0, 0, 0});
+        uint32_t root = 0;
+        m_roots.reserve(n + 1);
+        for (size_t l = 0; l <= n; ++l) {
+            for (auto i : byPrev[l]) root = insert(root, 0, n, i);
+            m_roots.push_back(root);
+        }
+    }
+
+    // number of distinct values over [a, b)
+    size_t distinct(K const& a, K const& b) const {
+        checkFresh();
+        if (!(a < b) || m_begins.empty()) return 0;
+        auto [l, r] = segmentRange(a, b);
+        if (l > r) return 0;
+        return count(m_roots[l], 0, m_begins.size(), l, r + 1);
+    }
+
+    // total length of [a, b) mapped to value
+    K length(V const& value, K const& a, K const& b) const {
+        checkFresh();
+        auto found = m_runs.find(value);
+        if (found == m_runs.end() || !(a < b)) return K{};
+        auto const& runs = found->second;
+
+        // runs overlapping [a, b): first with end > a, up to last with begin < b
+        auto first = std::upper_bound(runs.begin(), runs.end(), a, [](K const& key, Run const& run) { return key < run.end; });
+        auto last = std::lower_bound(first, runs.end(), b, [](Run const& run, K const& key) { return run.begin < key; });
+        if (first == last) return K{};
+
+        auto const& back = *std::prev(last);
+        K total = back.prefix + (back.end - back.begin) - first->prefix;
+        if (first->begin < a) total = total - (a - first->begin);
+        if (b < back.end) total = total - (back.end - b);
+        return total;
+    }
+
+    // false once the map has been assigned to since indexing
+    bool fresh() const { return m_version == m_map.version(); }
+
+private:
+    void checkFresh() const {
+        if (!fresh()) throw std::logic_error("interval_index queried after its interval_map changed");
+    }
+
+    // index range [l, r] of the segments overlapping [a, b)
+    std::pair<size_t, size_t> segmentRange(K const& a, K const& b) const {
+        auto l = std::upper_bound(m_begins.begin(), m_begins.end(), a);
+        auto r = std::lower_bound(m_begins.begin(), m_begins.end(), b);
+        size_t first = l == m_begins.begin() ? 0 : l - m_begins.begin() - 1;
+        if (r == m_begins.begin()) return {1, 0};
+        return {first, static_cast<size_t>(r - m_begins.begin()) - 1};
+    }
+
+    // path-copying insert of position pos into the tree over [lo, hi)
+    uint32_t insert(uint32_t node, size_t lo, size_t hi, size_t pos) {
+        auto copy = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.push_back(m_nodes[node]);
+        ++m_nodes[copy].count;
+        if (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (pos < mid) {
+                auto child = insert(m_nodes[node].left, lo, mid, pos);
+                m_nodes[copy].left = child;
+            } else {
+                auto child = insert(m_nodes[node].right, mid, hi, pos);
+                m_nodes[copy].right = child;
+            }
+        }
+        return copy;
+    }
+
+    // positions in [l, r) present in the tree over [lo, hi)
+    size_t count(uint32_t node, size_t lo, size_t hi, size_t l, size_t r) const {
+        if (node == 0 || r <= lo || hi <= l) return 0;
+        if (l <= lo && hi <= r) return m_nodes[node].count;
+        size_t mid = lo + (hi - lo) / 2;
+        return count(m_nodes[node].left, lo, mid, l, r) + count(m_nodes[node].right, mid, hi, l, r);
+    }
+};
+
+// Read-mostly variant: breakpoints live in sorted parallel key/value vectors and
+// point lookups go through an Eytzinger (BFS-order) copy of the keys, so a search
+// touches one predictable, prefetchable path instead of a red-black tree walk.
+// assign() only queues the update, commit() applies all queued updates in one
+// merge pass and rebuilds the index. Lookups see the state of the last commit().
+template<typename K, typename V>
+class flat_interval_map {
+    V m_valBegin;
+    std::vector<K> m_keys;      // canonical breakpoints, sorted
+    std::vector<V> m_values;
+    std::vector<K> m_eytzKeys;  // m_keys in Eytzinger order, 1-based
+    std::vector<V> m_eytzPrev;  // value in effect just before the key at the same node;
+                                // [0] is the value after the last key
+    std::vector<std::tuple<K, K, V>> m_pending;
+
+public:
+    template<typename V_forward>
+    flat_interval_map(V_forward&& val)
+    : m_valBegin(std::forward<V_forward>(val)) {
+        buildIndex();
+    }
+
+    // Queue the assignment of val to [keyBegin, keyEnd), applied by commit()
+    template<typename V_forward>
+    void assign(K const& keyBegin, K const& keyEnd, V_forward&& val)
+        requires (std::is_same<std::remove_cvref_t<V_forward>, V>::value)
+    {
+        m_pending.emplace_back(keyBegin, keyEnd, std::forward<V_forward>(val));
+    }
+
+    void commit() {
+        if (m_pending.empty()) return;
+
+        auto segments = interval_detail::resolveUpdates<K, V>(m_pending);
+        m_pending.clear();
+
+        std::vector<K> keys;
+        std::vector<V> values;
+        keys.reserve(m_keys.size() + 2 * segments.size());
+        values.reserve(m_keys.size() + 2 * segments.size());
+        interval_detail::mergeBreakpoints(m_valBegin, size_t{0}, m_keys.size(),
+            [&](size_t i) -> K const& { return m_keys[i]; },
+            [&](size_t i) -> V const& { return m_values[i]; },
+            segments,
+            [&](K const& key, V const& val) {
+                keys.push_back(key);
+                values.push_back(val);
+            });
+        m_keys = std::move(keys);
+        m_values = std::move(values);
+        buildIndex();
+    }
+
+    // look-up of the value associated with key
+    V const& operator[](K const& key) const {
+        size_t n = m_keys.size();
+        size_t k = 1;
+        while (k <= n) {
+            __builtin_prefetch(m_eytzKeys.data() + 16 * k);  // four levels ahead
+            k = 2 * k + !(key < m_eytzKeys[k]);                 // right while node <= key
+        }
+        k >>= __builtin_ffsll(~k);  // undo the trailing right turns: node of the first key > key
+        return m_eytzPrev[k];
+    }
+
+    size_t size() const { return m_keys.size(); }
+
+    void print() const {
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            std::cout << "[" << m_keys[i] << ':' << m_values[i] << "]";
+        }
+        std::cout << '\n';
+    }
+
+private:
+    void buildIndex() {
+        size_t n = m_keys.size();
+        m_eytzKeys.resize(n + 1);
+        m_eytzPrev.resize(n + 1);
+        m_eytzPrev[0] = n ? m_values[n - 1] : m_valBegin;
+
+        size_t rank = 0;
+        auto fill = [&](auto&& self, size_t k) -> void {
+            if (k > n) return;
+            self(self, 2 * k);
+            m_eytzKeys[k] = m_keys[rank];
+            m_eytzPrev[k] = rank ? m_values[rank - 1] : m_valBegin;
+            ++rank;
+            self(self, 2 * k + 1);
+        };
+        fill(fill, 1);
+    }
+};
+
+// One writer, many lock-free readers. The breakpoints live in a persistent treap:
+// assign() never mutates a published node, it path-copies O(log n) nodes into a
+// new version and publishes the new root with one atomic store. Readers announce
+// the epoch they start in, then walk whatever root they loaded; the writer frees
+// a retired version only once every announced epoch is newer than it.
+// Reference counts are touched by the writer only, readers never write shared memory
+// except their own epoch slot. Past MaxReaders concurrent snapshots a reader counts
+// itself in m_overflow instead, and the writer frees nothing while that count is
+// non-zero: more readers cost memory, never progress.
+template<typename K, typename V>
+class concurrent_interval_map {
+    struct Node {
+        K key;
+        V val;
+        uint64_t priority;
+        Node const* left;
+        Node const* right;
+        mutable size_t refs;    // parents + published versions, writer-only
+    };
+
+    static constexpr size_t MaxReaders = 64;
+    static constexpr uint64_t Idle = std::numeric_limits<uint64_t>::max();
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{Idle};
+    };
+
+    V m_valBegin;
+    std::atomic<Node const*> m_root{nullptr};
+    std::atomic<uint64_t> m_epoch{0};
+    mutable std::array<ReaderSlot, MaxReaders> m_readers;
+    mutable std::atomic<size_t> m_overflow{0};  // snapshots without a slot
+
+    // writer state
+    std::mutex m_writer;
+    std::vector<std::pair<uint64_t, Node const*>> m_retired;  // (epoch, old root)
+    uint64_t m_seed{0x9E3779B97F4A7C15ull};
+
+public:
+    // Consistent read-only view of one version. Pins its epoch slot until destroyed,
+    // so keep it short-lived: it delays reclamation, never the writer.
+    class Snapshot {
+        friend class concurrent_interval_map;
+        concurrent_interval_map const* m_owner;
+        ReaderSlot* m_slot{nullptr};  // nullptr: counted in m_overflow
+        Node const* m_root;
+
+        explicit Snapshot(concurrent_interval_map const& owner)
+        : m_owner(&owner) {
+            // one pass over the slots from where this thread last succeeded
+            thread_local size_t preferred = std::hash<std::thread::id>{}(std::this_thread::get_id());
+            auto epoch = owner.m_epoch.load();
+            for (size_t i = preferred; i < preferred + MaxReaders; ++i) {
+                auto& slot = owner.m_readers[i % MaxReaders];
+                uint64_t idle = Idle;
+                if (slot.epoch.compare_exchange_strong(idle, epoch)) {
+                    m_slot = &slot;
+                    preferred = i;
+                    break;
+                }
+            }
+            // seq_cst: either the writer sees the count, or this loads the new root
+            if (!m_slot) owner.m_overflow.fetch_add(1);
+            m_root = owner.m_root.load();
+        }
+
+    public:
+        Snapshot(Snapshot const&) = delete;
+        Snapshot& operator=(Snapshot const&) = delete;
+        ~Snapshot() {
+            if (m_slot) m_slot->epoch.store(Idle, std::memory_order_release);
+            else m_owner->m_overflow.fetch_sub(1, std::memory_order_release);
+        }
+
+        V const& operator[](K const& key) const {
+            Node const* found = nullptr;
+            for (auto n = m_root; n;) {
+                if (key < n->key) {
+                    n = n->left;
+                } else {
+                    found = n;
+                    n = n->right;
+                }
+            }
+            return found ? found->val : m_owner->m_valBegin;
+        }
+    };
+
+    template<typename V_forward>
+    concurrent_interval_map(V_forward&& val)
+    : m_valBegin(std::forward<V_forward>(val)) {}
+
+    ~concurrent_interval_map() {
+        for (auto& [epoch, root] : m_retired) release(root);
+        release(m_root.load());
+    }
+
+    Snapshot snapshot() const { return Snapshot(*this); }
+
+    // look-up of the value associated with key, never blocks
+    V operator[](K const& key) const {
+        return snapshot()[key];
+    }
+
+    // Assign value val to interval [keyBegin, keyEnd). Writers are serialized
+    // among themselves, readers are never waited for.
+    template<typename V_forward>
+    void assign(K const& keyBegin, K const& keyEnd, V_forward&& val)
+        requires (std::is_same<std::remove_cvref_t<V_forward>, V>::value)
+    {
+        if (!(keyBegin < keyEnd)) return; // Empty range, do nothing
+
+        std::lock_guard lock(m_writer);
+        Node const* root = m_root.load(std::memory_order_relaxed);
+
+        auto [left, rest] = split(root, keyBegin);      // [.., keyBegin) | [keyBegin, ..)
+        auto [middle, right] = split(rest, keyEnd);     // [keyBegin, keyEnd) | [keyEnd, ..)
+        release(rest);
+
+        V const* before = &m_valBegin;
+        if (auto last = maxNode(left)) before = &last->val;
+        Node const* endNode = minNode(right);
+        bool endExists = endNode && interval_detail::equal(endNode->key, keyEnd);
+        V const* after = before;
+        if (auto last = maxNode(middle)) after = &last->val;
+
+        // build the middle: [keyBegin:val] and [keyEnd:after] where they are needed
+        Node const* fresh = nullptr;
+        if (!endExists && !(*after == val)) {
+            fresh = makeNode(keyEnd, *after, nullptr, nullptr);
+        }
+        if (!(*before == val)) {
+            fresh = merge(makeNode(keyBegin, val, nullptr, nullptr), fresh);
+        }
+        if (endExists && endNode->val == val) {
+            auto tail = dropMin(right);  // breakpoint at keyEnd became redundant
+            release(right);
+            right = tail;
+        }
+        release(middle);
+
+        Node const* next = merge(merge(left, fresh), right);
+        m_root.store(next);
+        retire(root);
+    }
+
+private:
+    Node const* makeNode(K const& key, V const& val, Node const* left, Node const* right) {
+        // splitmix64: treap priorities only need to look random
+        uint64_t z = (m_seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return new Node{key, val, z ^ (z >> 31), left, right, 1};
+    }
+
+    Node const* copyNode(Node const* n, Node const* left, Node const* right) {
+        return new Node{n->key, n->val, n->priority, left, right, 1};
+    }
+
+    static Node const* share(Node const* n) {
+        if (n) ++n->refs;
+        return n;
+    }
+
+    static void release(Node const* n) {
+        while (n && --n->refs == 0) {
+            release(n->left);
+            auto right = n->right;
+            delete n;
+            n = right;
+        }
+    }
+
+    static Node const* minNode(Node const* n) {
+        while (n && n->left) n = n->left;
+        return n;
+    }
+
+    static Node const* maxNode(Node const* n) {
+        while (n && n->right) n = n->right;
+        return n;
+    }
+
+    // t without its smallest key; returns an owned reference, t is borrowed
+    Node const* dropMin(Node const* t) {
+        if (!t->left) return share(t->right);
+        return copyNode(t, dropMin(t->left), share(t->right));
+    }
+
+    // (keys < key, keys >= key); returns owned references, t is borrowed
+    std::pair<Node const*, Node const*> split(Node const* t, K const& key) {
+        if (!t) return {nullptr, nullptr};
+        if (t->key < key) {
+            auto [a, b] = split(t->right, key);
+            return {copyNode(t, share(t->left), a), b};
+        }
+        auto [a, b] = split(t->left, key);
+        return {a, copyNode(t, b, share(t->right))};
+    }
+
+    // all keys of a before all keys of b; consumes both references
+    Node const* merge(Node const* a, Node const* b) {
+        if (!a) return b;
+        if (!b) return a;
+        Node const* result;
+        if (a->priority > b->priority) {
+            result = copyNode(a, share(a->left), merge(share(a->right), b));
+            release(a);
+        } else {
+            result = copyNode(b, merge(a, share(b->left)), share(b->right));
+            release(b);
+        }
+        return result;
+    }
+
+    void retire(Node const* root) {
+        m_retired.emplace_back(m_epoch.fetch_add(1), root);
+        if (m_overflow.load() != 0) return;  // a reader without a slot may hold any of them
+
+        uint64_t oldest = Idle;
+        for (auto& slot : m_readers) oldest = std::min(oldest, slot.epoch.load());
+
+        // a reader that may still hold a version announced an epoch <= its retire epoch
+        auto it = m_retired.begin();
+        for (; it != m_retired.end() && it->first < oldest; ++it) release(it->second);
+        m_retired.erase(m_retired.begin(), it);
+    }
 };
 
 void testIntervalMap() {
@@ -89,7 +1056,442 @@ void testIntervalMap() {
 
 }
 
-int main() {
+// same random assigns on both maps, every lookup must agree
+void testFlatIntervalMap() {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> key(-50, 50), val('a', 'e');
+
+    for (int round = 0; round < 200; ++round) {
+        interval_map<int, char> reference{ 'a' };
+        flat_interval_map<int, char> flat{ 'a' };
+        for (int i = 0; i < 20; ++i) {
+            int b = key(gen), e = key(gen);
+            char v = static_cast<char>(val(gen));
+            reference.assign(b, e, v);
+            flat.assign(b, e, v);
+            if (i % 7 == 0) flat.commit();
+        }
+        flat.commit();
+        for (int k = -60; k <= 60; ++k) {
+            if (reference[k] != flat[k]) {
+                std::cout << "flat_interval_map mismatch at " << k << '\n';
+                return;
+            }
+        }
+    }
+    std::cout << "flat_interval_map OK\n";
+}
+
+// bulk assign / sorted lookup must match one-by-one assign / operator[]
+void testBulkIntervalMap() {
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<int> key(-100, 100), val('a', 'e');
+
+    for (int round = 0; round < 200; ++round) {
+        interval_map<int, char> reference{ 'a' };
+        interval_map<int, char> bulk{ 'a' };
+        for (int tick = 0; tick < 3; ++tick) {
+            std::vector<std::tuple<int, int, char>> updates;
+            for (int i = 0; i < 30; ++i) {
+                updates.emplace_back(key(gen), key(gen), static_cast<char>(val(gen)));
+                auto& [b, e, v] = updates.back();
+                reference.assign(b, e, v);
+            }
+            bulk.assign_bulk(updates);
+        }
+
+        std::vector<int> keys;
+        for (int k = -110; k <= 110; k += 1 + static_cast<int>(gen() % 20)) keys.push_back(k);
+        std::vector<char> out(keys.size());
+        bulk.lookup_sorted(keys, out);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (reference[keys[i]] != bulk[keys[i]] || out[i] != reference[keys[i]]) {
+                std::cout << "assign_bulk/lookup_sorted mismatch at " << keys[i] << '\n';
+                return;
+            }
+        }
+    }
+    std::cout << "assign_bulk/lookup_sorted OK\n";
+}
+
+// thousands of updates and lookups per tick on a 100k-interval map
+void benchmarkBulkIntervalMap() {
+    constexpr int Intervals = 100'000;
+    constexpr int Ticks = 20;
+    constexpr int PerTick = 5'000;
+
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<int> key(0, 1 << 24);
+    auto randomUpdates = [&](int count) {
+        std::vector<std::tuple<int, int, int>> updates;
+        for (int i = 0; i < count; ++i) {
+            int b = key(gen);
+            updates.emplace_back(b, b + 1 + (key(gen) & 0xff), i);
+        }
+        return updates;
+    };
+
+    interval_map<int, int> single{ -1 }, bulk{ -1 };
+    auto initial = randomUpdates(Intervals);
+    single.assign_bulk(initial);
+    bulk.assign_bulk(initial);
+
+    std::vector<std::vector<std::tuple<int, int, int>>> ticks;
+    for (int t = 0; t < Ticks; ++t) ticks.push_back(randomUpdates(PerTick));
+    std::vector<int> probes(PerTick);
+    std::generate(probes.begin(), probes.end(), [&] { return key(gen); });
+    std::sort(probes.begin(), probes.end());
+    std::vector<int> out(PerTick);
+
+    using us = std::chrono::duration<double, std::micro>;
+    long sum = 0, bulkSum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (auto& updates : ticks) {
+        for (auto& [b, e, v] : updates) single.assign(b, e, v);
+        for (int k : probes) sum += single[k];
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (auto& updates : ticks) {
+        bulk.assign_bulk(updates);
+        bulk.lookup_sorted(probes, out);
+        for (int v : out) bulkSum += v;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "per tick, one by one: " << us(middle - begin).count() / Ticks << " us\n";
+    std::cout << "per tick, bulk:       " << us(end - middle).count() / Ticks << " us"
+              << (sum == bulkSum ? "" : " (MISMATCH)") << '\n';
+}
+
+// single-threaded agreement with interval_map, then readers running against a writer
+void testConcurrentIntervalMap() {
+    std::mt19937 gen(3);
+    std::uniform_int_distribution<int> key(-50, 50), val('a', 'e');
+    for (int round = 0; round < 200; ++round) {
+        interval_map<int, char> reference{ 'a' };
+        concurrent_interval_map<int, char> concurrent{ 'a' };
+        for (int i = 0; i < 20; ++i) {
+            int b = key(gen), e = key(gen);
+            char v = static_cast<char>(val(gen));
+            reference.assign(b, e, v);
+            concurrent.assign(b, e, v);
+        }
+        for (int k = -60; k <= 60; ++k) {
+            if (reference[k] != concurrent[k]) {
+                std::cout << "concurrent_interval_map mismatch at " << k << '\n';
+                return;
+            }
+        }
+    }
+
+    // the writer only ever raises [0, 1000), so inside one snapshot every key
+    // must read the same value and across snapshots it never goes down
+    concurrent_interval_map<int, int> shared{ 0 };
+    std::atomic<bool> done{false}, failed{false};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&] {
+            int last = 0;
+            while (!done.load()) {
+                auto snapshot = shared.snapshot();
+                int first = snapshot[0];
+                if (first < last || snapshot[999] != first || snapshot[500] != first) failed = true;
+                last = first;
+            }
+        });
+    }
+    for (int v = 1; v <= 20'000; ++v) {
+        shared.assign(0, 1000, v);
+        shared.assign(v % 1000, v % 1000 + 1, v); // churn inside the range
+        shared.assign(0, 1000, v);
+    }
+    done = true;
+    for (auto& t : readers) t.join();
+
+    // more live snapshots than slots: the extra ones must not wait, nor lose their version
+    auto hold = [&](auto&& self, int depth) -> void {
+        auto snapshot = shared.snapshot();
+        if (depth == 0) shared.assign(0, 1000, -1);
+        else self(self, depth - 1);
+        if (snapshot[0] != 20'000) failed = true;
+    };
+    hold(hold, 100);
+    if (shared[0] != -1) failed = true;
+
+    std::cout << (failed ? "concurrent_interval_map readers saw a torn state\n" : "concurrent_interval_map OK\n");
+}
+
+// reader throughput while one thread keeps assigning: lock-free snapshots vs a mutex
+void benchmarkConcurrentIntervalMap() {
+    constexpr int Intervals = 100'000;
+    constexpr int Readers = 4;
+    constexpr auto Duration = std::chrono::milliseconds(300);
+
+    std::mt19937 gen(9);
+    std::uniform_int_distribution<int> key(0, 1 << 24);
+    std::vector<std::tuple<int, int, int>> updates;
+    for (int i = 0; i < Intervals; ++i) {
+        int b = key(gen);
+        updates.emplace_back(b, b + 1 + (key(gen) & 0xff), i);
+    }
+
+    auto run = [&](auto&& name, auto&& assign, auto&& lookup) {
+        std::atomic<bool> done{false};
+        std::atomic<long> lookups{0};
+        long writes = 0;
+        std::vector<std::thread> readers;
+        for (int r = 0; r < Readers; ++r) {
+            readers.emplace_back([&, r] {
+                std::mt19937 local(r);
+                long count = 0, sum = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    sum += lookup(static_cast<int>(local() & 0xffffff));
+                    ++count;
+                }
+                lookups += count + (sum & 0);
+            });
+        }
+        auto begin = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - begin < Duration) {
+            auto& [b, e, v] = updates[writes++ % Intervals];
+            assign(b, e, v);
+        }
+        done = true;
+        for (auto& t : readers) t.join();
+        double seconds = std::chrono::duration<double>(Duration).count();
+        std::cout << name << ": " << lookups / seconds / 1e6 << " M lookups/s, "
+                  << writes / seconds / 1e3 << " k assigns/s\n";
+    };
+
+    {
+        interval_map<int, int> map{ -1 };
+        map.assign_bulk(updates);
+        std::mutex mutex;
+        run("mutex + interval_map    ",
+            [&](int b, int e, int v) { std::lock_guard lock(mutex); map.assign(b, e, v); },
+            [&](int k) { std::lock_guard lock(mutex); return map[k]; });
+    }
+    {
+        concurrent_interval_map<int, int> map{ -1 };
+        for (auto& [b, e, v] : updates) map.assign(b, e, v);
+        run("concurrent_interval_map ",
+            [&](int b, int e, int v) { map.assign(b, e, v); },
+            [&](int k) { return map[k]; });
+    }
+}
+
+// segment iteration and range aggregates against a brute force walk of every key
+void testIntervalQueries() {
+    std::mt19937 gen(13);
+    std::uniform_int_distribution<int> key(-50, 50), val('a', 'f');
+    for (int round = 0; round < 200; ++round) {
+        interval_map<int, char> map{ 'a' };
+        for (int i = 0; i < 15; ++i) {
+            map.assign(key(gen), key(gen), static_cast<char>(val(gen)));
+        }
+        interval_index<int, char> index(map, -60, 60);
+
+        for (int query = 0; query < 20; ++query) {
+            int a = key(gen), b = key(gen);
+
+            // segments must tile [a, b) with the values of operator[]
+            int expected = a;
+            bool ok = true;
+            char previous = 0;
+            for (auto [begin, end, value] : map.segments(a, b)) {
+                ok &= begin == expected && begin < end && value != previous;
+                for (int k = begin; k < end; ++k) ok &= map[k] == value;
+                expected = end;
+                previous = value;
+            }
+            ok &= !(a < b) || expected == b;
+
+            std::set<char> distinct;
+            for (int k = a; k < b; ++k) distinct.insert(map[k]);
+            ok &= index.distinct(a, b) == distinct.size();
+            for (char v = 'a'; v <= 'f'; ++v) {
+                int length = 0;
+                for (int k = a; k < b; ++k) length += map[k] == v;
+                ok &= index.length(v, a, b) == length;
+            }
+
+            if (!ok) {
+                std::cout << "interval queries mismatch on [" << a << ", " << b << ")\n";
+                return;
+            }
+        }
+
+        // an empty assign leaves the index usable, any other one must be noticed
+        map.assign(5, 5, 'a');
+        bool stale = !index.fresh();
+        map.assign(key(gen), 60, 'a');
+        try {
+            index.distinct(-60, 60);
+        } catch (std::logic_error const&) {
+            stale = !stale && !index.fresh();
+        }
+        if (!stale) {
+            std::cout << "interval_index used after its map changed\n";
+            return;
+        }
+    }
+    std::cout << "segments/interval_index OK\n";
+}
+
+// save + mmap view must answer like the map it was written from
+void testMappedIntervalMap() {
+    auto path = (std::filesystem::temp_directory_path() / "interval_map_test.bin").string();
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<int> key(-5000, 5000), val(0, 300);  // > 256 values: 2-byte indices
+    for (int round = 0; round < 20; ++round) {
+        interval_map<int, int> map{ -1 };
+        for (int i = 0; i < 2000; ++i) {
+            map.assign(key(gen), key(gen), val(gen));
+        }
+        map.save(path);
+        mapped_interval_map<int, int> view(path);
+        for (int k = -5100; k <= 5100; ++k) {
+            if (map[k] != view[k]) {
+                std::cout << "mapped_interval_map mismatch at " << k << '\n';
+                return;
+            }
+        }
+    }
+    if (std::filesystem::exists(path + ".tmp")) {
+        std::cout << "mapped_interval_map left " << path << ".tmp behind\n";
+        return;
+    }
+
+    // a damaged header or block index must be rejected when opening
+    using interval_file::Header;
+    auto pristine = [&] {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(in), {});
+    }();
+    auto rejects = [&](size_t offset, auto value, size_t truncate = 0) {
+        auto bytes = pristine;
+        std::memcpy(bytes.data() + offset, &value, sizeof(value));
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() - truncate);
+        try {
+            mapped_interval_map<int, int> view(path);
+            return false;
+        } catch (std::runtime_error const&) {
+            return true;
+        }
+    };
+    Header header;
+    std::memcpy(&header, pristine.data(), sizeof(header));
+    if (!rejects(offsetof(Header, count), header.count, 1)
+        || !rejects(offsetof(Header, indexWidth), uint32_t{3})
+        || !rejects(offsetof(Header, count), header.count + 1000)
+        || !rejects(offsetof(Header, blockCount), header.blockCount + 1)
+        || !rejects(offsetof(Header, valBeginIndex), static_cast<uint32_t>(header.dictCount))
+        || !rejects(offsetof(Header, blockOffsetsOffset), header.blockOffsetsOffset + 4)
+        || !rejects(offsetof(Header, deltasOffset), header.dictOffset + 8)
+        || !rejects(offsetof(Header, dictOffset), ~uint64_t{7})
+        || !rejects(offsetof(Header, indicesOffset), header.fileSize)
+        || !rejects(header.blockOffsetsOffset + (header.blockCount - 1) * 8, ~uint64_t{0})) {
+        std::cout << "mapped_interval_map accepted a corrupt file\n";
+        return;
+    }
+    std::filesystem::remove(path);
+    std::cout << "mapped_interval_map OK\n";
+}
+
+// cold start: rebuild from updates vs opening the saved file
+void benchmarkMappedIntervalMap() {
+    constexpr int Intervals = 1'000'000;
+    constexpr int Lookups = 1'000'000;
+    auto path = (std::filesystem::temp_directory_path() / "interval_map_bench.bin").string();
+
+    std::mt19937 gen(21);
+    std::uniform_int_distribution<int> key(0, 1 << 30);
+    std::vector<std::tuple<int, int, int>> updates;
+    for (int i = 0; i < Intervals; ++i) {
+        int b = key(gen);
+        updates.emplace_back(b, b + 1 + (key(gen) & 0xfff), i % 1000);
+    }
+    std::vector<int> probes(Lookups);
+    std::generate(probes.begin(), probes.end(), [&] { return key(gen); });
+
+    using ms = std::chrono::duration<double, std::milli>;
+    using ns = std::chrono::duration<double, std::nano>;
+
+    auto begin = std::chrono::steady_clock::now();
+    interval_map<int, int> map{ -1 };
+    map.assign_bulk(updates);
+    auto built = std::chrono::steady_clock::now();
+    map.save(path);
+
+    auto opening = std::chrono::steady_clock::now();
+    mapped_interval_map<int, int> view(path);
+    auto opened = std::chrono::steady_clock::now();
+    long sum = 0, viewSum = 0;
+    for (int k : probes) viewSum += view[k];
+    auto end = std::chrono::steady_clock::now();
+    for (int k : probes) sum += map[k];
+
+    std::cout << "rebuild " << ms(built - begin).count() << " ms, mmap open " << ms(opened - opening).count()
+              << " ms, mapped lookup " << ns(end - opened).count() / Lookups << " ns"
+              << (sum == viewSum ? "" : " (MISMATCH)") << ", "
+              << static_cast<double>(view.fileSize()) / view.size() << " bytes/breakpoint\n";
+    std::filesystem::remove(path);
+}
+
+// 1M intervals, random point lookups
+void benchmarkIntervalMap() {
+    constexpr int Intervals = 1'000'000;
+    constexpr int Lookups = 10'000'000;
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> key(0, 1 << 30);
+    std::vector<std::tuple<int, int, int>> updates;
+    for (int i = 0; i < Intervals; ++i) {
+        int b = key(gen);
+        updates.emplace_back(b, b + 1 + (key(gen) & 0xfff), i);
+    }
+    std::vector<int> probes(Lookups);
+    std::generate(probes.begin(), probes.end(), [&] { return key(gen); });
+
+    using ms = std::chrono::duration<double, std::milli>;
+    using ns = std::chrono::duration<double, std::nano>;
+
+    auto begin = std::chrono::steady_clock::now();
+    interval_map<int, int> tree{ -1 };
+    for (auto& [b, e, v] : updates) tree.assign(b, e, v);
+    auto built = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (int k : probes) sum += tree[k];
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "std::map: assign " << ms(built - begin).count() << " ms, lookup "
+              << ns(end - built).count() / Lookups << " ns\n";
+
+    begin = std::chrono::steady_clock::now();
+    flat_interval_map<int, int> flat{ -1 };
+    for (auto& [b, e, v] : updates) flat.assign(b, e, v);
+    flat.commit();
+    built = std::chrono::steady_clock::now();
+    long flatSum = 0;
+    for (int k : probes) flatSum += flat[k];
+    end = std::chrono::steady_clock::now();
+    std::cout << "flat:     assign " << ms(built - begin).count() << " ms, lookup "
+              << ns(end - built).count() / Lookups << " ns"
+              << (sum == flatSum ? "" : " (MISMATCH)") << " [" << flat.size() << " breakpoints]\n";
+}
+
+// ./problem runs the tests, ./problem bench the benchmarks as well
+int main(int argc, char* argv[]) {
     testIntervalMap();
+    testFlatIntervalMap();
+    testBulkIntervalMap();
+    testConcurrentIntervalMap();
+    testIntervalQueries();
+    testMappedIntervalMap();
+    if (argc > 1 && std::string_view(argv[1]) == "bench") {
+        benchmarkIntervalMap();
+        benchmarkBulkIntervalMap();
+        benchmarkConcurrentIntervalMap();
+        benchmarkMappedIntervalMap();
+    }
     return 0;
 }
@@ -0,0 +1,528 @@
+#pragma once
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "utils.h"
+
+// Asynchronous backend of the color print macros, enabled by compiling with
+// -DUTILS_ASYNC_LOG. A log call copies its raw arguments into a record of the
+// calling thread's SPSC ring and returns: it never blocks, a full ring drops the
+// record (counted, reported by the backend). One background thread renders the
+// records with StringCreator and writes them in batches with writev.
+//
+// A record is one fixed-size slot; a longer one continues over the following
+// slots, up to MaxRecordSlots. Past that the line is rendered at the call site,
+// cut, and ends with TruncatedMarker (counted and reported like drops).
+//
+// Lines of one thread keep their order, lines of different threads are not
+// interleaved but may be reordered, and they are not ordered with std::cout.
+// Utils::AsyncLog::flush() waits until everything logged so far is written.
+namespace Utils::AsyncLog
+{
+    constexpr size_t RecordSize = 256;
+    constexpr size_t RingCapacity = 1024;   // slots per thread
+    constexpr size_t MaxRecordSlots = 64;   // longest record, in slots
+    constexpr std::string_view TruncatedMarker = "…[truncated]";
+
+    struct Record
+    {
+        using Render = void (*)(const std::byte* payload, std::string& out);
+
+        Render render;
+        uint32_t color;     // Definition::Color, 0 for printAuto: no color, no '\n'
+        uint32_t size;      // payload bytes, the ones past payload in the next slots
+        std::byte payload[RecordSize - sizeof(Render) - 2 * sizeof(uint32_t)];
+
+        // slots taken by a record of size payload bytes
+        static constexpr size_t slots(size_t size)
+        {
+            return size <= sizeof(payload) ? 1 : 1 + (size - sizeof(payload) + RecordSize - 1) / RecordSize;
+        }
+    };
+    static_assert(sizeof(Record) == RecordSize);
+    static_assert(MaxRecordSlots <= RingCapacity);
+
+    constexpr size_t MaxPayload = sizeof(Record::payload) + (MaxRecordSlots - 1) * RecordSize;
+
+    // what a record keeps of an argument, rendered later by the backend:
+    //     trivially copyable values           raw bytes
+    //     text                                uint32 length, bytes
+    //     vector, set, array, map             uint32 count, elements
+    //     pair                                both values
+    // the same encoding as Utils::BinaryLog; anything else is rendered to text at
+    // the call site
+    template <typename T>
+    constexpr bool is_text = std::is_convertible_v<const T&, std::string_view>;
+
+    template <typename T> constexpr bool is_sequence = false;
+    template <typename T> constexpr bool is_sequence<std::vector<T>> = true;
+    template <typename T> constexpr bool is_sequence<std::set<T>> = true;
+    template <typename T, size_t N> constexpr bool is_sequence<std::array<T, N>> = true;
+    template <typename K, typename V> constexpr bool is_sequence<std::map<K, V>> = true;
+
+    template <typename T> constexpr bool is_pair = false;
+    template <typename K, typename V> constexpr bool is_pair<std::pair<K, V>> = true;
+
+    template <typename T>
+    constexpr bool is_raw = std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_array_v<T>
+                         && !is_text<T> && !is_sequence<T> && !is_pair<T>;
+
+    namespace Detail
+    {
+        using Length = uint32_t;
+
+        // into [p, end), or appended to spill when set
+        struct Writer
+        {
+            std::byte* p;
+            std::byte* end;
+            bool overflow{false};
+            std::vector<std::byte>* spill{nullptr};
+
+            void bytes(const void* data, size_t size)
+            {
+                if (spill)
+                {
+                    auto* begin = static_cast<const std::byte*>(data);
+                    spill->insert(spill->end(), begin, begin + size);
+                    return;
+                }
+                if (overflow || size > static_cast<size_t>(end - p))
+                {
+                    overflow = true;
+                    return;
+                }
+                std::memcpy(p, data, size);
+                p += size;
+            }
+
+            void length(size_t size)
+            {
+                auto n = static_cast<Length>(size);
+                bytes(&n, sizeof(n));
+            }
+
+            void text(std::string_view text)
+            {
+                length(text.size());
+                bytes(text.data(), text.size());
+            }
+
+            template <typename T>
+            void arg(const T& value)
+            {
+                if constexpr (is_raw<T>)
+                {
+                    bytes(&value, sizeof(T));
+                }
+                else if constexpr (is_text<T>)
+                {
+                    text(std::string_view(value));
+                }
+                else if constexpr (is_sequence<T>)
+                {
+                    length(std::size(value));
+                    // through value_type: vector<bool> hands out proxies
+                    for (const auto& element : value) arg<std::remove_cv_t<typename T::value_type>>(element);
+                }
+                else if constexpr (is_pair<T>)
+                {
+                    arg(value.first);
+                    arg(value.second);
+                }
+                else
+                {
+                    text(StringCreator::format(value));
+                }
+            }
+        };
+
+        // reads back what Writer::arg wrote, with the punctuation of StringCreator
+        struct Reader
+        {
+            const std::byte* p;
+
+            template <typename T>
+            T read()
+            {
+                alignas(T) std::byte storage[sizeof(T)];
+                std::memcpy(storage, p, sizeof(T));
+                p += sizeof(T);
+                return *std::launder(reinterpret_cast<const T*>(storage));
+            }
+
+            template <typename T>
+            void arg(std::string& out)
+            {
+                if constexpr (is_raw<T>)
+                {
+                    StringCreator::append(out, read<T>());
+                }
+                else if constexpr (is_sequence<T>)
+                {
+                    auto count = read<Length>();
+                    out.push_back('{');
+                    for (Length i = 0; i < count; ++i)
+                    {
+                        if (i != 0) out.push_back(',');
+                        arg<std::remove_cv_t<typename T::value_type>>(out);
+                    }
+                    out.push_back('}');
+                }
+                else if constexpr (is_pair<T>)
+                {
+                    out.push_back('{');
+                    arg<std::remove_cv_t<typename T::first_type>>(out);
+                    out.push_back(',');
+                    arg<std::remove_cv_t<typename T::second_type>>(out);
+                    out.push_back('}');
+                }
+                else
+                {
+                    auto size = read<Length>();
+                    out.append(reinterpret_cast<const char*>(p), size);
+                    p += size;
+                }
+            }
+        };
+
+        template <typename... Args>
+        void render(const std::byte* payload, std::string& out)
+        {
+            Reader reader{payload};
+            (reader.arg<Args>(out), ...);
+        }
+
+        // single-producer single-consumer ring of records, one per logging thread
+        class Ring
+        {
+        public:
+            // producer side: the first of count free slots, nullptr when full
+            Record* claim(size_t count = 1)
+            {
+                auto tail = m_tail.load(std::memory_order_relaxed);
+                if (tail + count - m_headCache > RingCapacity)
+                {
+                    m_headCache = m_head.load(std::memory_order_acquire);
+                    if (tail + count - m_headCache > RingCapacity)
+                    {
+                        m_dropped.fetch_add(1, std::memory_order_relaxed);
+                        return nullptr;
+                    }
+                }
+                return &m_records[tail % RingCapacity];
+            }
+
+            // the slot index slots after the first claimed one, as raw bytes
+            std::byte* claimed(size_t index) { return reinterpret_cast<std::byte*>(&m_records[(m_tail.load(std::memory_order_relaxed) + index) % RingCapacity]); }
+
+            void publish(size_t count = 1) { m_tail.store(m_tail.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+            void truncated() { m_truncated.fetch_add(1, std::memory_order_relaxed); }
+
+            // consumer side
+            size_t head() const { return m_head.load(std::memory_order_relaxed); }
+            size_t tail() const { return m_tail.load(std::memory_order_acquire); }
+            const Record& at(size_t index) const { return m_records[index % RingCapacity]; }
+            void release(size_t head) { m_head.store(head, std::memory_order_release); }
+
+            size_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+            size_t truncatedCount() const { return m_truncated.load(std::memory_order_relaxed); }
+            std::atomic<bool> closed{false};    // owning thread exited
+
+        private:
+            alignas(64) std::atomic<size_t> m_tail{0};
+            size_t m_headCache{0};
+            alignas(64) std::atomic<size_t> m_head{0};
+            alignas(64) std::atomic<size_t> m_dropped{0};
+            std::atomic<size_t> m_truncated{0};
+            std::array<Record, RingCapacity> m_records;
+        };
+
+        class Backend
+        {
+        public:
+            static Backend& instance()
+            {
+                static Backend backend;
+                return backend;
+            }
+
+            void add(std::shared_ptr<Ring> ring)
+            {
+                std::lock_guard lock(m_mutex);
+                m_rings.push_back(std::move(ring));
+            }
+
+            // waits until every record published before the call is written
+            void flush()
+            {
+                auto target = m_drained.load(std::memory_order_acquire) + 2;
+                while (m_drained.load(std::memory_order_acquire) < target)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+
+        private:
+            Backend() : m_thread([this] { run(); })
+            {
+            }
+
+            ~Backend()
+            {
+                m_stop.store(true, std::memory_order_release);
+                m_thread.join();
+            }
+
+            void run()
+            {
+                auto idle = std::chrono::microseconds(50);
+                for (;;)
+                {
+                    auto stopping = m_stop.load(std::memory_order_acquire);
+                    auto written = drain();
+                    m_drained.fetch_add(1, std::memory_order_release);
+                    if (written == 0)
+                    {
+                        if (stopping) break;
+                        std::this_thread::sleep_for(idle);
+                        idle = std::min(idle * 2, std::chrono::microseconds(1000));
+                    }
+                    else
+                    {
+                        idle = std::chrono::microseconds(50);
+                    }
+                }
+            }
+
+            // renders everything published, one line per iovec, returns the records written
+            size_t drain()
+            {
+                std::vector<std::shared_ptr<Ring>> rings;
+                {
+                    std::lock_guard lock(m_mutex);
+                    rings = m_rings;
+                }
+
+                size_t written = 0;
+                for (auto& ring : rings)
+                {
+                    auto closed = ring->closed.load(std::memory_order_acquire);
+                    auto head = ring->head();
+                    auto tail = ring->tail();
+                    while (head != tail)
+                    {
+                        const auto& record = ring->at(head);
+                        auto slots = Record::slots(record.size);
+                        const auto* payload = record.payload;
+                        if (slots > 1)
+                        {
+                            // continued record: gather it, the slots may wrap around the ring
+                            m_scratch.resize(record.size);
+                            std::memcpy(m_scratch.data(), record.payload, sizeof(record.payload));
+                            for (size_t k = 1, at = sizeof(record.payload); k < slots; ++k, at += RecordSize)
+                            {
+                                std::memcpy(m_scratch.data() + at, &ring->at(head + k), std::min(RecordSize, record.size - at));
+                            }
+                            payload = m_scratch.data();
+                        }
+                        head += slots;
+
+                        auto start = m_batch.size();
+                        if (record.color != 0)
+                        {
+                            StringCreator::append(m_batch, "\033[", record.color, "m");
+                        }
+                        record.render(payload, m_batch);
+                        if (record.color != 0)
+                        {
+                            StringCreator::append(m_batch, Definition::ColorReset, '\n');
+                        }
+                        m_lines.emplace_back(start, m_batch.size() - start);
+                        ++written;
+                    }
+                    ring->release(head);
+
+                    auto& reported = m_reported[ring.get()];
+                    auto dropped = ring->dropped();
+                    if (dropped != reported.dropped)
+                    {
+                        auto start = m_batch.size();
+                        StringCreator::append(m_batch, "[async log] ", dropped - reported.dropped, " records dropped\n");
+                        m_lines.emplace_back(start, m_batch.size() - start);
+                        reported.dropped = dropped;
+                    }
+                    auto truncated = ring->truncatedCount();
+                    if (truncated != reported.truncated)
+                    {
+                        auto start = m_batch.size();
+                        StringCreator::append(m_batch, "[async log] ", truncated - reported.truncated, " records truncated\n");
+                        m_lines.emplace_back(start, m_batch.size() - start);
+                        reported.truncated = truncated;
+                    }
+                    if (closed && head == ring->tail())
+                    {
+                        m_reported.erase(ring.get());
+                        std::lock_guard lock(m_mutex);
+                        std::erase(m_rings, ring);
+                    }
+                }
+                write();
+                return written;
+            }
+
+            void write()
+            {
+                // iovecs point into the batch only now that it no longer grows
+                std::vector<iovec> iov;
+                iov.reserve(std::min<size_t>(m_lines.size(), IOV_MAX));
+                for (size_t i = 0; i < m_lines.size();)
+                {
+                    iov.clear();
+                    for (; i < m_lines.size() && iov.size() < IOV_MAX; ++i)
+                    {
+                        iov.push_back({m_batch.data() + m_lines[i].first, m_lines[i].second});
+                    }
+                    writeAll(iov);
+                }
+                m_batch.clear();
+                m_lines.clear();
+            }
+
+            static void writeAll(std::vector<iovec>& iov)
+            {
+                auto* first = iov.data();
+                auto count = static_cast<int>(iov.size());
+                while (count > 0)
+                {
+                    auto n = ::writev(STDOUT_FILENO, first, count);
+                    if (n < 0)
+                    {
+                        if (errno == EINTR) continue;
+                        return;     // nowhere to report it, the lines are lost
+                    }
+                    // skip what was written, possibly part of a line
+                    for (; count > 0 && static_cast<size_t>(n) >= first->iov_len; ++first, --count)
+                    {
+                        n -= static_cast<ssize_t>(first->iov_len);
+                    }
+                    if (count > 0)
+                    {
+                        first->iov_base = static_cast<char*>(first->iov_base) + n;
+                        first->iov_len -= static_cast<size_t>(n);
+                    }
+                }
+            }
+
+            std::mutex m_mutex;     // guards m_rings against registering threads only
+            std::vector<std::shared_ptr<Ring>> m_rings;
+            struct Reported
+            {
+                size_t dropped = 0;
+                size_t truncated = 0;
+            };
+            std::map<const Ring*, Reported> m_reported;
+            std::vector<std::byte> m_scratch;   // continued record being rendered
+            std::string m_batch;
+            std::vector<std::pair<size_t, size_t>> m_lines;     // (offset, size) in m_batch
+            std::atomic<uint64_t> m_drained{0};
+            std::atomic<bool> m_stop{false};
+            std::thread m_thread;
+        };
+
+        inline Ring& threadRing()
+        {
+            thread_local struct Owner
+            {
+                std::shared_ptr<Ring> ring = std::make_shared<Ring>();
+                Owner() { Backend::instance().add(ring); }
+                ~Owner() { ring->closed.store(true, std::memory_order_release); }
+            } owner;
+            return *owner.ring;
+        }
+
+        template <typename... Args>
+        void log(uint32_t color, const Args&... args)
+        {
+            auto& ring = threadRing();
+            auto* record = ring.claim();
+            if (!record) return;
+
+            Writer writer{record->payload, record->payload + sizeof(record->payload)};
+            (writer.arg(args), ...);
+            if (!writer.overflow)
+            {
+                record->render = &render<Args...>;
+                record->color = color;
+                record->size = static_cast<uint32_t>(writer.p - record->payload);
+                ring.publish();
+                return;
+            }
+
+            // longer than a slot: encode again into a buffer, continued over the next slots
+            thread_local std::vector<std::byte> spill;
+            spill.clear();
+            writer = Writer{nullptr, nullptr, false, &spill};
+            (writer.arg(args), ...);
+            Record::Render renderer = &render<Args...>;
+            if (spill.size() > MaxPayload)
+            {
+                // encoding too long: render now, the text may still fit
+                thread_local std::string line;
+                line.clear();
+                StringCreator::append(line, args...);
+                if (line.size() > MaxPayload - sizeof(Length))
+                {
+                    // keep what fits, cut before a UTF-8 continuation byte, and say so
+                    auto keep = MaxPayload - sizeof(Length) - TruncatedMarker.size();
+                    while (keep > 0 && (static_cast<unsigned char>(line[keep]) & 0xC0) == 0x80) --keep;
+                    line.resize(keep);
+                    line += TruncatedMarker;
+                    ring.truncated();
+                }
+                spill.clear();
+                writer.text(line);
+                renderer = &render<std::string_view>;
+            }
+
+            auto slots = Record::slots(spill.size());
+            record = ring.claim(slots);
+            if (!record) return;
+            std::memcpy(record->payload, spill.data(), sizeof(record->payload));
+            for (size_t k = 1, at = sizeof(record->payload); k < slots; ++k, at += RecordSize)
+            {
+                std::memcpy(ring.claimed(k), spill.data() + at, std::min(RecordSize, spill.size() - at));
+            }
+            record->render = renderer;
+            record->color = color;
+            record->size = static_cast<uint32_t>(spill.size());
+            ring.publish(slots);
+        }
+    }
+
+    // same output as Utils::print / Utils::printAuto, written by the backend thread
+    template <typename... Args>
+    void print(Definition::Color color, const Args&... args)
+    {
+        Detail::log(to_underlying(color), args...);
+    }
+
+    template <typename... Args>
+    void printAuto(const Args&... args)
+    {
+        Detail::log(0, args...);
+    }
+
+    inline void flush()
+    {
+        Detail::Backend::instance().flush();
+    }
+}
@@ -0,0 +1,472 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+
+#include "utils.h"
+
+// Micro-benchmarks with statistics, where time_elapsed gives a single sample:
+//     void sum(Utils::Bench::State& state)
+//     {
+//         std::vector<int> data(state.arg(), 1);
+//         for (auto _ : state)
+//         {
+//             Utils::Bench::DoNotOptimize(std::accumulate(data.begin(), data.end(), 0));
+//         }
+//     }
+//     UTILS_BENCHMARK(sum, 1000, 1000000);    // one run per argument
+//
+//     int main(int argc, char* argv[]) { return Utils::Bench::run(argc, argv); }
+//
+// Each benchmark is calibrated to an iteration count lasting --min-time, warmed
+// up for --warmup, then timed --repetitions times; the report gives the mean,
+// median, standard deviation and p99 of the time per iteration over the
+// repetitions. --counters adds cycles, instructions and cache misses per
+// iteration from perf_event_open (calling thread only), --json=path writes the
+// results as JSON, --filter=text runs the benchmarks whose name contains text.
+namespace Utils::Bench
+{
+    // keeps value, and what it depends on, from being optimized away
+    template <typename T>
+    inline void DoNotOptimize(const T& value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // and may have been modified: GCC takes no alternatives for in-out operands,
+    // scalars go through a register, anything else through memory
+    template <typename T>
+    inline void DoNotOptimize(T& value)
+    {
+        if constexpr ((std::is_arithmetic_v<T> || std::is_pointer_v<T>) && sizeof(T) <= sizeof(void*))
+        {
+            asm volatile("" : "+r"(value) : : "memory");
+        }
+        else
+        {
+            asm volatile("" : "+m"(value) : : "memory");
+        }
+    }
+
+    // forces pending writes to memory to happen here
+    inline void ClobberMemory()
+    {
+        asm volatile("" : : : "memory");
+    }
+
+    struct Options
+    {
+        std::string filter;
+        size_t repetitions = 10;
+        double minTime = 0.05;      // seconds per repetition
+        double warmup = 0.1;        // seconds
+        bool counters = false;
+        std::string json;           // path, none when empty
+    };
+
+    // cycles, instructions, cache misses of the calling thread, as one group
+    class Counters
+    {
+    public:
+        static constexpr size_t Count = 3;
+        static constexpr std::array<std::string_view, Count> Names{"cycles", "instructions", "cache_misses"};
+
+        Counters()
+        {
+            constexpr uint64_t configs[Count] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+            for (size_t i = 0; i < Count; ++i)
+            {
+                perf_event_attr attr{};
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = configs[i];
+                attr.disabled = i == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP;
+                auto group = i == 0 ? -1 : m_fds[0];
+                m_fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+                if (m_fds[i] < 0)
+                {
+                    m_error = std::string("perf_event_open: ") + std::strerror(errno);
+                    close();
+                    return;
+                }
+            }
+        }
+
+        ~Counters() { close(); }
+
+        Counters(const Counters&) = delete;
+        Counters& operator=(const Counters&) = delete;
+
+        bool available() const { return m_fds[0] >= 0; }
+        const std::string& error() const { return m_error; }
+
+        void start()
+        {
+            if (!available()) return;
+            ::ioctl(m_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ::ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        // stops and restarts counting, keeping the counts
+        void pause()
+        {
+            if (available()) ::ioctl(m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        void resume()
+        {
+            if (available()) ::ioctl(m_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        // counts since start(), without the paused spans
+        std::array<uint64_t, Count> stop()
+        {
+            std::array<uint64_t, Count> values{};
+            if (!available()) return values;
+            ::ioctl(m_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t buffer[1 + Count];     // nr, then the values
+            if (::read(m_fds[0], buffer, sizeof(buffer)) == static_cast<ssize_t>(sizeof(buffer)))
+            {
+                std::copy(buffer + 1, buffer + 1 + Count, values.begin());
+            }
+            return values;
+        }
+
+    private:
+        void close()
+        {
+            for (auto& fd : m_fds)
+            {
+                if (fd >= 0) ::close(fd);
+                fd = -1;
+            }
+        }
+
+        std::array<int, Count> m_fds{-1, -1, -1};
+        std::string m_error;
+    };
+
+    // what a benchmark function sees: its argument, and the timed loop
+    //     for (auto _ : state) { ... }
+    class State
+    {
+    public:
+        State(size_t iterations, std::optional<int64_t> arg, Counters* counters)
+            : m_iterations(iterations), m_arg(arg), m_counters(counters)
+        {
+        }
+
+        // throws std::logic_error for a benchmark registered without arguments
+        int64_t arg() const
+        {
+            if (!m_arg) throw std::logic_error("benchmark registered without arguments");
+            return *m_arg;
+        }
+
+        size_t iterations() const { return m_iterations; }
+
+        // excludes the work between the two calls from the time and the counters
+        void pauseTiming()
+        {
+            m_elapsed += std::chrono::steady_clock::now() - m_begin;
+            if (m_counters) m_counters->pause();
+        }
+
+        void resumeTiming()
+        {
+            if (m_counters) m_counters->resume();
+            m_begin = std::chrono::steady_clock::now();
+        }
+
+        // variables of this type may go unused: "for (auto _ : state)" warns for nothing
+        struct [[gnu::unused]] Value
+        {
+        };
+
+        struct Iterator
+        {
+            size_t remaining;
+            State* state;
+
+            bool operator!=(const Iterator&)
+            {
+                if (remaining != 0) [[likely]] return true;
+                state->finish();
+                return false;
+            }
+            void operator++() { --remaining; }
+            Value operator*() const { return {}; }
+        };
+
+        Iterator begin()
+        {
+            if (m_counters) m_counters->start();
+            m_begin = std::chrono::steady_clock::now();
+            return {m_iterations, this};
+        }
+
+        Iterator end() { return {0, this}; }
+
+        // after the loop
+        double seconds() const { return std::chrono::duration<double>(m_elapsed).count(); }
+        const std::array<uint64_t, Counters::Count>& counts() const { return m_counts; }
+        bool finished() const { return m_finished; }
+
+    private:
+        void finish()
+        {
+            m_elapsed += std::chrono::steady_clock::now() - m_begin;
+            if (m_counters) m_counts = m_counters->stop();
+            m_finished = true;
+        }
+
+        size_t m_iterations;
+        std::optional<int64_t> m_arg;
+        Counters* m_counters;
+        std::chrono::steady_clock::time_point m_begin;
+        std::chrono::steady_clock::duration m_elapsed{};
+        std::array<uint64_t, Counters::Count> m_counts{};
+        bool m_finished = false;
+    };
+
+    using Function = void (*)(State&);
+
+    struct Benchmark
+    {
+        std::string name;
+        Function function;
+        std::optional<int64_t> arg;
+    };
+
+    struct Result
+    {
+        std::string name;
+        size_t iterations = 0;          // per repetition
+        std::vector<double> samples;    // ns per iteration, one per repetition
+        double mean = 0;
+        double median = 0;
+        double stddev = 0;
+        double p99 = 0;
+        std::optional<std::array<double, Counters::Count>> counters;   // per iteration
+    };
+
+    class Registry
+    {
+    public:
+        static Registry& instance()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        // one benchmark per argument, named name/arg, or a single one without
+        bool add(std::string_view name, Function function, std::initializer_list<int64_t> args = {})
+        {
+            if (args.size() == 0)
+            {
+                m_benchmarks.push_back({std::string(name), function, std::nullopt});
+            }
+            for (auto arg : args)
+            {
+                m_benchmarks.push_back({StringCreator::to_string(name, '/', arg), function, arg});
+            }
+            return true;
+        }
+
+        const std::vector<Benchmark>& benchmarks() const { return m_benchmarks; }
+
+    private:
+        std::vector<Benchmark> m_benchmarks;
+    };
+
+    namespace Detail
+    {
+        // one call of the function with iterations, returns its state
+        inline State once(const Benchmark& benchmark, size_t iterations, Counters* counters)
+        {
+            State state(iterations, benchmark.arg, counters);
+            benchmark.function(state);
+            if (!state.finished()) throw std::logic_error(benchmark.name + ": the benchmark never ran its loop");
+            return state;
+        }
+
+        inline size_t calibrate(const Benchmark& benchmark, double minTime)
+        {
+            size_t iterations = 1;
+            for (;;)
+            {
+                auto seconds = once(benchmark, iterations, nullptr).seconds();
+                if (seconds >= minTime || iterations >= (size_t{1} << 40)) return iterations;
+
+                // aim 20% past minTime, growing at least twice, at most 100 times
+                auto target = seconds > 0 ? minTime * 1.2 / seconds * static_cast<double>(iterations) : 100.0 * static_cast<double>(iterations);
+                iterations = std::clamp(static_cast<size_t>(target), iterations * 2, iterations * 100);
+            }
+        }
+
+        inline Result measure(const Benchmark& benchmark, const Options& options, Counters* counters)
+        {
+            Result result;
+            result.name = benchmark.name;
+            result.iterations = calibrate(benchmark, options.minTime);
+
+            auto warmupEnd = std::chrono::steady_clock::now() + std::chrono::duration<double>(options.warmup);
+            while (std::chrono::steady_clock::now() < warmupEnd)
+            {
+                once(benchmark, result.iterations, nullptr);
+            }
+
+            std::array<double, Counters::Count> totals{};
+            for (size_t r = 0; r < options.repetitions; ++r)
+            {
+                auto state = once(benchmark, result.iterations, counters);
+                result.samples.push_back(state.seconds() * 1e9 / static_cast<double>(result.iterations));
+                for (size_t i = 0; i < Counters::Count; ++i) totals[i] += static_cast<double>(state.counts()[i]);
+            }
+
+            auto sorted = result.samples;
+            std::sort(sorted.begin(), sorted.end());
+            auto n = static_cast<double>(sorted.size());
+            result.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / n;
+            result.median = sorted.size() % 2 ? sorted[sorted.size() / 2] : (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2;
+            double squares = 0;
+            for (auto s : sorted) squares += (s - result.mean) * (s - result.mean);
+            result.stddev = sorted.size() > 1 ? std::sqrt(squares / (n - 1)) : 0;
+            result.p99 = sorted[static_cast<size_t>(std::ceil(0.99 * n)) - 1];     // nearest rank
+
+            if (counters && counters->available())
+            {
+                std::array<double, Counters::Count> perIteration{};
+                for (size_t i = 0; i < Counters::Count; ++i)
+                {
+                    perIteration[i] = totals[i] / (n * static_cast<double>(result.iterations));
+                }
+                result.counters = perIteration;
+            }
+            return result;
+        }
+
+        inline std::string json(const std::vector<Result>& results, const Options& options)
+        {
+            std::string out;
+            StringCreator::append(out, "{\n  \"context\": {\"repetitions\": ", options.repetitions,
+                                  ", \"min_time_s\": ", options.minTime, ", \"warmup_s\": ", options.warmup,
+                                  ", \"threads\": ", std::thread::hardware_concurrency(), "},\n  \"benchmarks\": [");
+            for (size_t b = 0; b < results.size(); ++b)
+            {
+                const auto& r = results[b];
+                StringCreator::append(out, b ? ",\n" : "\n", "    {\"name\": \"", r.name, "\", \"iterations\": ", r.iterations,
+                                      ", \"mean_ns\": ", r.mean, ", \"median_ns\": ", r.median, ", \"stddev_ns\": ", r.stddev,
+                                      ", \"p99_ns\": ", r.p99, ", \"samples_ns\": [");
+                for (size_t i = 0; i < r.samples.size(); ++i) StringCreator::append(out, i ? ", " : "", r.samples[i]);
+                out += "]";
+                if (r.counters)
+                {
+                    out += ", \"counters\": {";
+                    for (size_t i = 0; i < Counters::Count; ++i)
+                    {
+                        StringCreator::append(out, i ? ", \"" : "\"", Counters::Names[i], "\": ", (*r.counters)[i]);
+                    }
+                    out += "}";
+                }
+                out += "}";
+            }
+            out += "\n  ]\n}\n";
+            return out;
+        }
+    }
+
+    // runs the registered benchmarks matching options, prints one line each
+    inline std::vector<Result> run(const Options& options)
+    {
+        std::optional<Counters> counters;
+        if (options.counters)
+        {
+            counters.emplace();
+            if (!counters->available())
+            {
+                print(Definition::Color::Yellow, "hardware counters unavailable, ", counters->error());
+            }
+        }
+
+        std::vector<Result> results;
+        for (const auto& benchmark : Registry::instance().benchmarks())
+        {
+            if (benchmark.name.find(options.filter) == std::string::npos) continue;
+
+            auto result = Detail::measure(benchmark, options, counters ? &*counters : nullptr);
+            std::string line;
+            StringCreator::append(line, result.name, ": median ", result.median, " mean ", result.mean,
+                                  " stddev ", result.stddev, " p99 ", result.p99, "[ns] ",
+                                  result.iterations, " iterations x ", result.samples.size());
+            if (result.counters)
+            {
+                for (size_t i = 0; i < Counters::Count; ++i) StringCreator::append(line, ' ', Counters::Names[i], ' ', (*result.counters)[i]);
+            }
+            print(Definition::Color::Green, line);
+            results.push_back(std::move(result));
+        }
+
+        if (!options.json.empty())
+        {
+            std::ofstream file(options.json);
+            file << Detail::json(results, options);
+            if (!file) throw std::runtime_error("cannot write " + options.json);
+        }
+        return results;
+    }
+
+    // options from the command line, see the top of this file; returns the
+    // exit code: 0, or 1 with a message for an invalid option. Errors of the
+    // benchmarks themselves are thrown.
+    inline int run(int argc, char* argv[])
+    {
+        Options options;
+        try
+        {
+            for (int i = 1; i < argc; ++i)
+            {
+                std::string_view arg = argv[i];
+                auto value = [&](std::string_view flag) -> std::optional<std::string>
+                {
+                    if (!arg.starts_with(flag) || arg.size() <= flag.size() || arg[flag.size()] != '=') return std::nullopt;
+                    return std::string(arg.substr(flag.size() + 1));
+                };
+                if (auto v = value("--filter")) options.filter = *v;
+                else if (auto v = value("--repetitions")) options.repetitions = std::max<size_t>(std::stoul(*v), 1);
+                else if (auto v = value("--min-time")) options.minTime = std::stod(*v);
+                else if (auto v = value("--warmup")) options.warmup = std::stod(*v);
+                else if (auto v = value("--json")) options.json = *v;
+                else if (arg == "--counters") options.counters = true;
+                else throw std::invalid_argument("unknown option " + std::string(arg));
+            }
+        }
+        catch (const std::exception& e)     // invalid_argument, or out_of_range from a number
+        {
+            print(Definition::Color::Red, e.what());
+            std::cout << "options: --filter=text --repetitions=n --min-time=seconds --warmup=seconds --counters --json=path\n";
+            return 1;
+        }
+        run(options);
+        return 0;
+    }
+}
+
+#define UTILS_BENCH_CONCAT_(a, b)    a##b
+#define UTILS_BENCH_CONCAT(a, b)     UTILS_BENCH_CONCAT_(a, b)
+
+// registers function, a void(Utils::Bench::State&), once per argument given
+#define UTILS_BENCHMARK(function, ...)                                                  \
+    static const bool UTILS_BENCH_CONCAT(utils_benchmark_, __LINE__) =                   \
+        Utils::Bench::Registry::instance().add(#function, function, {__VA_ARGS__})
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "utils.h"
+
+#if !defined(__x86_64__) || !defined(__ELF__)
+#error "binaryLog.h emits its callsite descriptors for x86-64 ELF"
+#endif
+
+// Binary backend of the color print macros, enabled by compiling with
+// -DUTILS_BINARY_LOG. Nothing is formatted at run time: a log call stores the ID
+// of its callsite, a timestamp and the raw bytes of its arguments in a ring file
+// mapped in memory, and binlogDecode renders it offline to the text
+// StringCreator would have produced.
+//
+// Every callsite owns a constant Descriptor (file, line, color, argument
+// signature) emitted at compile time in the utils_binlog section; its ID is its
+// index in that section, fixed at link time (x86-64 ELF only). All descriptors are copied into the
+// file when it is opened, so the decoder needs only the file.
+//
+// Arguments are encoded by type, the signature telling the decoder how to read
+// them back:
+//     arithmetic (c b a h s t i j l m x y f d e)   raw bytes
+//     S                                            uint32 length, bytes
+//     V<element>                                   uint32 count, elements (vector, set, array)
+//     P<first><second>                             both values (pair, and map as V of P)
+// Any other type is rendered with StringCreator at the call site and stored as S.
+//
+// The ring keeps the newest records: a full ring overwrites the oldest ones.
+namespace Utils::BinaryLog
+{
+    constexpr char Magic[8] = {'U', 'B', 'L', 'O', 'G', '0', '0', '1'};
+    constexpr size_t DefaultCapacity = 64 << 20;
+
+    struct alignas(32) Descriptor
+    {
+        const char* file;
+        uint32_t line;
+        uint32_t color;
+        const char* signature;
+    };
+    static_assert(sizeof(Descriptor) == 32);
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint64_t capacity;          // ring bytes, a power of two
+        uint64_t dataOffset;        // of the ring in the file
+        uint64_t metaOffset;        // of the descriptor table: per descriptor uint32 line, uint32 color,
+                                    // uint16 length + file name, uint16 length + signature
+        uint64_t metaSize;
+        int64_t systemStart;        // system_clock and steady_clock at open, ns
+        int64_t steadyStart;
+        alignas(64) std::atomic<uint64_t> head;    // bytes ever reserved
+        std::atomic<uint64_t> dropped;             // records larger than a quarter of the ring
+    };
+
+    // every record starts 8-byte aligned and never wraps around the ring end;
+    // offset, its absolute position, is stored last and tells a complete record
+    struct RecordHeader
+    {
+        uint32_t size;              // header and payload, multiple of 8
+        uint32_t id;                // descriptor index, Padding up to the ring end
+        uint64_t offset;
+        int64_t time;               // steady_clock, ns
+    };
+    static_assert(sizeof(RecordHeader) == 24);
+
+    constexpr uint32_t Padding = UINT32_MAX;
+
+    namespace Detail
+    {
+        template <size_t... N>
+        consteval auto concat(const std::array<char, N>&... parts)
+        {
+            std::array<char, (N + ... + 0)> out{};
+            size_t i = 0;
+            ((std::copy(parts.begin(), parts.end(), out.begin() + i), i += parts.size()), ...);
+            return out;
+        }
+
+        template <typename T>
+        consteval char scalarCode()
+        {
+            if constexpr (std::is_same_v<T, char>)                    return 'c';
+            else if constexpr (std::is_same_v<T, bool>)               return 'b';
+            else if constexpr (std::is_same_v<T, signed char>)        return 'a';
+            else if constexpr (std::is_same_v<T, unsigned char>)      return 'h';
+            else if constexpr (std::is_same_v<T, short>)              return 's';
+            else if constexpr (std::is_same_v<T, unsigned short>)     return 't';
+            else if constexpr (std::is_same_v<T, int>)                return 'i';
+            else if constexpr (std::is_same_v<T, unsigned>)           return 'j';
+            else if constexpr (std::is_same_v<T, long>)               return 'l';
+            else if constexpr (std::is_same_v<T, unsigned long>)      return 'm';
+            else if constexpr (std::is_same_v<T, long long>)          return 'x';
+            else if constexpr (std::is_same_v<T, unsigned long long>) return 'y';
+            else if constexpr (std::is_same_v<T, float>)              return 'f';
+            else if constexpr (std::is_same_v<T, double>)             return 'd';
+            else if constexpr (std::is_same_v<T, long double>)        return 'e';
+            else                                                      return 0;
+        }
+
+        template <typename T> constexpr bool is_sequence = false;
+        template <typename T> constexpr bool is_sequence<std::vector<T>> = true;
+        template <typename T> constexpr bool is_sequence<std::set<T>> = true;
+        template <typename T, size_t N> constexpr bool is_sequence<std::array<T, N>> = true;
+        template <typename K, typename V> constexpr bool is_sequence<std::map<K, V>> = true;
+
+        template <typename T> constexpr bool is_pair = false;
+        template <typename K, typename V> constexpr bool is_pair<std::pair<K, V>> = true;
+
+        template <typename T>
+        consteval auto signature()
+        {
+            if constexpr (scalarCode<T>() != 0)
+            {
+                return std::array<char, 1>{scalarCode<T>()};
+            }
+            else if constexpr (is_sequence<T>)
+            {
+                return concat(std::array<char, 1>{'V'}, signature<std::remove_cv_t<typename T::value_type>>());
+            }
+            else if constexpr (is_pair<T>)
+            {
+                return concat(std::array<char, 1>{'P'}, signature<std::remove_cv_t<typename T::first_type>>(),
+                              signature<std::remove_cv_t<typename T::second_type>>());
+            }
+            else
+            {
+                return std::array<char, 1>{'S'};     // text, or rendered at the call site
+            }
+        }
+
+        template <typename... Args>
+        constexpr auto Signature = concat(signature<Args>()..., std::array<char, 1>{'\0'});
+
+        // The descriptor of a callsite, Where being a lambda unique to the macro
+        // expansion that returns it without its signature. It is emitted by the
+        // assembler: GCC ignores section attributes in template instantiations.
+        template <typename Where, typename... Args>
+        inline const Descriptor* site()
+        {
+            constexpr Descriptor where = Where{}();
+            const Descriptor* descriptor;
+            asm(".pushsection utils_binlog, \"aw\"\n\t"
+                ".balign 32\n"
+                "0:\n\t"
+                ".quad %c1\n\t"
+                ".long %c2\n\t"
+                ".long %c3\n\t"
+                ".quad %c4\n\t"
+                ".quad 0\n\t"
+                ".popsection\n\t"
+                "lea 0b(%%rip), %0"
+                : "=r"(descriptor)
+                : "i"(where.file), "i"(where.line), "i"(where.color), "i"(Signature<Args...>.data()));
+            return descriptor;
+        }
+
+        struct Encoder
+        {
+            std::string& out;
+
+            void bytes(const void* data, size_t size) { out.append(static_cast<const char*>(data), size); }
+
+            void length(size_t size)
+            {
+                auto n = static_cast<uint32_t>(size);
+                bytes(&n, sizeof(n));
+            }
+
+            template <typename T>
+            void put(const T& value)
+            {
+                if constexpr (scalarCode<T>() != 0)
+                {
+                    bytes(&value, sizeof(T));
+                }
+                else if constexpr (is_sequence<T>)
+                {
+                    length(std::size(value));
+                    // through value_type: vector<bool> hands out proxies
+                    for (const auto& element : value) put<std::remove_cv_t<typename T::value_type>>(element);
+                }
+                else if constexpr (is_pair<T>)
+                {
+                    put(value.first);
+                    put(value.second);
+                }
+                else
+                {
+                    std::string_view text;
+                    if constexpr (std::is_convertible_v<const T&, std::string_view>) text = value;
+                    else text = StringCreator::format(value);
+                    length(text.size());
+                    bytes(text.data(), text.size());
+                }
+            }
+        };
+    }
+}
+
+// bounds of the descriptor section, provided by the linker
+extern "C" const Utils::BinaryLog::Descriptor __start_utils_binlog[] __attribute__((weak));
+extern "C" const Utils::BinaryLog::Descriptor __stop_utils_binlog[] __attribute__((weak));
+
+namespace Utils::BinaryLog
+{
+    inline int64_t nanoseconds(auto time) { return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count(); }
+
+    class File
+    {
+    public:
+        // creates (truncates) path with a ring of capacity bytes, rounded up to a power of two
+        File(const std::string& path, size_t capacity)
+        {
+            m_capacity = std::bit_ceil(std::max<size_t>(capacity, 1 << 16));
+
+            std::string meta;
+            for (const auto* d = __start_utils_binlog; d != __stop_utils_binlog; ++d)
+            {
+                auto put = [&](const void* data, size_t size) { meta.append(static_cast<const char*>(data), size); };
+                auto text = [&](std::string_view s)
+                {
+                    auto n = static_cast<uint16_t>(std::min<size_t>(s.size(), UINT16_MAX));
+                    put(&n, sizeof(n));
+                    put(s.data(), n);
+                };
+                put(&d->line, sizeof(d->line));
+                put(&d->color, sizeof(d->color));
+                text(d->file ? d->file : "");
+                text(d->signature);
+            }
+
+            auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            auto metaOffset = sizeof(FileHeader);
+            auto dataOffset = (metaOffset + meta.size() + page - 1) / page * page;
+            m_size = dataOffset + m_capacity;
+
+            auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) throw std::runtime_error("binary log: cannot open " + path + ": " + std::strerror(errno));
+            if (::ftruncate(fd, static_cast<off_t>(m_size)) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("binary log: cannot size " + path + ": " + std::strerror(errno));
+            }
+            auto* map = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (map == MAP_FAILED) throw std::runtime_error("binary log: cannot map " + path + ": " + std::strerror(errno));
+
+            m_base = static_cast<std::byte*>(map);
+            m_ring = m_base + dataOffset;
+            std::memcpy(m_base + metaOffset, meta.data(), meta.size());
+
+            m_header = new (m_base) FileHeader{};
+            std::memcpy(m_header->magic, Magic, sizeof(Magic));
+            m_header->capacity = m_capacity;
+            m_header->dataOffset = dataOffset;
+            m_header->metaOffset = metaOffset;
+            m_header->metaSize = meta.size();
+            m_header->systemStart = nanoseconds(std::chrono::system_clock::now());
+            m_header->steadyStart = nanoseconds(std::chrono::steady_clock::now());
+        }
+
+        ~File()
+        {
+            ::msync(m_base, m_size, MS_SYNC);
+            ::munmap(m_base, m_size);
+        }
+
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        void write(uint32_t id, std::string_view payload)
+        {
+            auto size = (sizeof(RecordHeader) + payload.size() + 7) & ~size_t{7};
+            if (size > m_capacity / 4)
+            {
+                m_header->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            // reserve, padding to the ring end first when the record would wrap
+            auto head = m_header->head.load(std::memory_order_relaxed);
+            uint64_t start;
+            do
+            {
+                auto room = m_capacity - head % m_capacity;
+                start = size <= room ? head : head + room;
+            } while (!m_header->head.compare_exchange_weak(head, start + size, std::memory_order_relaxed));
+
+            // a tail shorter than a header is left as is, the decoder skips it
+            if (start - head >= sizeof(RecordHeader))
+            {
+                commit(head, static_cast<uint32_t>(start - head), Padding, 0, {});
+            }
+            commit(start, static_cast<uint32_t>(size), id, nanoseconds(std::chrono::steady_clock::now()), payload);
+        }
+
+    private:
+        void commit(uint64_t offset, uint32_t size, uint32_t id, int64_t time, std::string_view payload)
+        {
+            auto* p = m_ring + offset % m_capacity;
+            auto* header = reinterpret_cast<RecordHeader*>(p);
+            if (!payload.empty()) std::memcpy(p + sizeof(RecordHeader), payload.data(), payload.size());
+            header->size = size;
+            header->id = id;
+            header->time = time;
+            std::atomic_ref(header->offset).store(offset, std::memory_order_release);
+        }
+
+        FileHeader* m_header;
+        std::byte* m_base;
+        std::byte* m_ring;
+        size_t m_capacity;
+        size_t m_size;
+    };
+
+    namespace Detail
+    {
+        inline std::mutex g_openMutex;
+        inline std::unique_ptr<File> g_file;
+        inline std::atomic<File*> g_current{nullptr};
+
+        inline File& file()
+        {
+            if (auto* f = g_current.load(std::memory_order_acquire)) [[likely]] return *f;
+
+            std::lock_guard lock(g_openMutex);
+            if (!g_file)
+            {
+                auto* path = std::getenv("UTILS_BINLOG_FILE");
+                g_file = std::make_unique<File>(path ? path : "utils.binlog", DefaultCapacity);
+                g_current.store(g_file.get(), std::memory_order_release);
+            }
+            return *g_file;
+        }
+
+        template <typename Where, typename... Args>
+        void log(const Args&... args)
+        {
+            thread_local std::string payload;
+            payload.clear();
+            Encoder encoder{payload};
+            (encoder.put(args), ...);
+
+            auto id = static_cast<uint32_t>(site<Where, Args...>() - __start_utils_binlog);
+            file().write(id, payload);
+        }
+    }
+
+    // Optional, before the first log call: the file to write instead of
+    // $UTILS_BINLOG_FILE or ./utils.binlog. Throws std::runtime_error.
+    inline void open(const std::string& path, size_t capacity = DefaultCapacity)
+    {
+        std::lock_guard lock(Detail::g_openMutex);
+        if (Detail::g_file) throw std::runtime_error("binary log: already open");
+        Detail::g_file = std::make_unique<File>(path, capacity);
+        Detail::g_current.store(Detail::g_file.get(), std::memory_order_release);
+    }
+}
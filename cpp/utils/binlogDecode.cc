@@ -0,0 +1,286 @@
+// Offline decoder of the files written by Utils::BinaryLog (-DUTILS_BINARY_LOG):
+// prints every record still in the ring, oldest first, as the color macro would
+// have printed it.
+//
+//     g++ -std=c++23 -O2 binlogDecode.cc -o binlogDecode
+//     ./binlogDecode [-t] [-p] utils.binlog
+//         -t   prefix each line with [seconds since the file was opened]
+//         -p   plain text, without the color escape sequences
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "binaryLog.h"
+
+namespace
+{
+    using namespace Utils::BinaryLog;
+
+    struct Site
+    {
+        uint32_t line;
+        uint32_t color;
+        std::string file;
+        std::string signature;
+    };
+
+    class Decoder
+    {
+    public:
+        Decoder(const std::byte* payload, const std::byte* end, std::string& out) : m_p(payload), m_end(end), m_out(out)
+        {
+        }
+
+        // renders one value of signature sig, returns the rest of the signature
+        std::string_view value(std::string_view sig)
+        {
+            if (sig.empty()) throw std::runtime_error("empty signature");
+            auto code = sig[0];
+            sig.remove_prefix(1);
+            switch (code)
+            {
+                case 'c': scalar<char>(); break;
+                case 'b': scalar<bool>(); break;
+                case 'a': scalar<signed char>(); break;
+                case 'h': scalar<unsigned char>(); break;
+                case 's': scalar<short>(); break;
+                case 't': scalar<unsigned short>(); break;
+                case 'i': scalar<int>(); break;
+                case 'j': scalar<unsigned>(); break;
+                case 'l': scalar<long>(); break;
+                case 'm': scalar<unsigned long>(); break;
+                case 'x': scalar<long long>(); break;
+                case 'y': scalar<unsigned long long>(); break;
+                case 'f': scalar<float>(); break;
+                case 'd': scalar<double>(); break;
+                case 'e': scalar<long double>(); break;
+                case 'S':
+                {
+                    auto size = read<uint32_t>();
+                    need(size);
+                    m_out.append(reinterpret_cast<const char*>(m_p), size);
+                    m_p += size;
+                    break;
+                }
+                case 'V':
+                {
+                    // same punctuation as StringCreator's collections
+                    auto count = read<uint32_t>();
+                    auto element = sig;
+                    m_out.push_back('{');
+                    for (uint32_t i = 0; i < count; ++i)
+                    {
+                        if (i != 0) m_out.push_back(',');
+                        sig = value(element);
+                    }
+                    if (count == 0) sig = skip(element);
+                    m_out.push_back('}');
+                    break;
+                }
+                case 'P':
+                    m_out.push_back('{');
+                    sig = value(sig);
+                    m_out.push_back(',');
+                    sig = value(sig);
+                    m_out.push_back('}');
+                    break;
+                default:
+                    throw std::runtime_error(std::string("unknown type code ") + code);
+            }
+            return sig;
+        }
+
+    private:
+        // the signature following one value, without reading any
+        static std::string_view skip(std::string_view sig)
+        {
+            auto code = sig[0];
+            sig.remove_prefix(1);
+            if (code == 'V') return skip(sig);
+            if (code == 'P') return skip(skip(sig));
+            return sig;
+        }
+
+        void need(size_t size) const
+        {
+            if (size > static_cast<size_t>(m_end - m_p)) throw std::runtime_error("record shorter than its signature");
+        }
+
+        template <typename T>
+        T read()
+        {
+            need(sizeof(T));
+            T value;
+            std::memcpy(&value, m_p, sizeof(T));
+            m_p += sizeof(T);
+            return value;
+        }
+
+        template <typename T>
+        void scalar()
+        {
+            Utils::StringCreator::append(m_out, read<T>());
+        }
+
+        const std::byte* m_p;
+        const std::byte* m_end;
+        std::string& m_out;
+    };
+
+    std::vector<Site> readSites(const std::byte* meta, const std::byte* end)
+    {
+        std::vector<Site> sites;
+        auto get = [&](void* data, size_t size)
+        {
+            if (size > static_cast<size_t>(end - meta)) throw std::runtime_error("truncated descriptor table");
+            std::memcpy(data, meta, size);
+            meta += size;
+        };
+        auto text = [&]
+        {
+            uint16_t size;
+            get(&size, sizeof(size));
+            std::string s(size, '\0');
+            get(s.data(), size);
+            return s;
+        };
+        while (meta != end)
+        {
+            Site site;
+            get(&site.line, sizeof(site.line));
+            get(&site.color, sizeof(site.color));
+            site.file = text();
+            site.signature = text();
+            sites.push_back(std::move(site));
+        }
+        return sites;
+    }
+
+    int decode(const char* path, bool time, bool color)
+    {
+        auto fd = ::open(path, O_RDONLY);
+        if (fd < 0) throw std::runtime_error(std::string("cannot open ") + path + ": " + std::strerror(errno));
+        struct stat st;
+        ::fstat(fd, &st);
+        auto size = static_cast<size_t>(st.st_size);
+        if (size < sizeof(FileHeader))
+        {
+            ::close(fd);
+            throw std::runtime_error(std::string(path) + " is not a binary log");
+        }
+        auto* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) throw std::runtime_error(std::string("cannot map ") + path + ": " + std::strerror(errno));
+
+        const auto* base = static_cast<const std::byte*>(map);
+        const auto* header = reinterpret_cast<const FileHeader*>(base);
+        if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->dataOffset + header->capacity > size
+            || header->metaOffset + header->metaSize > header->dataOffset)
+        {
+            throw std::runtime_error(std::string(path) + " is not a binary log");
+        }
+
+        auto sites = readSites(base + header->metaOffset, base + header->metaOffset + header->metaSize);
+        const auto* ring = base + header->dataOffset;
+        auto capacity = header->capacity;
+        auto head = header->head.load(std::memory_order_acquire);
+
+        // only the last capacity bytes are still there: walk from the first
+        // complete record after that point, skipping 8 bytes at a time over
+        // records never completed or cut by the wrap
+        std::string line;
+        size_t records = 0;
+        size_t broken = 0;
+        for (auto offset = head > capacity ? head - capacity : 0; offset + sizeof(RecordHeader) <= head;)
+        {
+            if (offset % capacity + sizeof(RecordHeader) > capacity)
+            {
+                offset += capacity - offset % capacity;     // tail too short for a record
+                continue;
+            }
+            RecordHeader record;
+            std::memcpy(&record, ring + offset % capacity, sizeof(record));
+            bool complete = record.offset == offset && record.size >= sizeof(RecordHeader) && record.size % 8 == 0
+                         && offset % capacity + record.size <= capacity && offset + record.size <= head;
+            if (!complete)
+            {
+                offset += 8;
+                continue;
+            }
+            if (record.id != Padding)
+            {
+                line.clear();
+                try
+                {
+                    if (record.id >= sites.size()) throw std::runtime_error("unknown callsite");
+                    const auto& site = sites[record.id];
+                    if (time)
+                    {
+                        char stamp[32];
+                        std::snprintf(stamp, sizeof(stamp), "[%.6f] ", static_cast<double>(record.time - header->steadyStart) / 1e9);
+                        line += stamp;
+                    }
+                    if (color) Utils::StringCreator::append(line, "\033[", site.color, "m");
+                    const auto* payload = ring + offset % capacity + sizeof(RecordHeader);
+                    Decoder decoder(payload, ring + offset % capacity + record.size, line);
+                    for (std::string_view sig = site.signature; !sig.empty();)
+                    {
+                        sig = decoder.value(sig);
+                    }
+                    if (color) line += Definition::ColorReset;
+                    line.push_back('\n');
+                    std::fwrite(line.data(), 1, line.size(), stdout);
+                    ++records;
+                }
+                catch (const std::exception& e)
+                {
+                    std::fprintf(stderr, "record at %llu: %s\n", static_cast<unsigned long long>(offset), e.what());
+                    ++broken;
+                }
+            }
+            offset += record.size;
+        }
+
+        auto dropped = header->dropped.load(std::memory_order_relaxed);
+        if (dropped != 0 || broken != 0)
+        {
+            std::fprintf(stderr, "%zu records, %zu undecodable, %llu dropped as too large\n", records, broken,
+                         static_cast<unsigned long long>(dropped));
+        }
+        ::munmap(map, size);
+        return broken == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool time = false;
+    bool color = true;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "-t") time = true;
+        else if (arg == "-p") color = false;
+        else path = argv[i];
+    }
+    if (!path)
+    {
+        std::fprintf(stderr, "usage: %s [-t] [-p] file\n", argv[0]);
+        return 2;
+    }
+
+    try
+    {
+        return decode(path, time, color);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+}
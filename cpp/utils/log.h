@@ -0,0 +1,256 @@
+#pragma once
+
+#include "utils.h"
+
+// Leveled logging with "{}" placeholders:
+//     LOG_INFO("fare {} balance {}", fare, balance);
+// - levels below UTILS_LOG_MIN_LEVEL (compile-time, default Debug) compile to
+//   nothing: the call sits in a discarded if constexpr, arguments are not evaluated
+// - the format is checked at compile time: a placeholder count that differs from
+//   the argument count, or an unmatched brace, is a compile error ("{{" and "}}"
+//   are literal braces)
+// - every callsite has its own enable flag, the only cost of a disabled callsite
+//   being one relaxed atomic load; see setRuntimeLevel() and setEnabled()
+// Lines are colored by level and written with Utils::print, or the async backend
+// with UTILS_ASYNC_LOG.
+namespace Utils::Log
+{
+    enum class Level : uint8_t
+    {
+        Trace,
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Off
+    };
+
+#ifndef UTILS_LOG_MIN_LEVEL
+#define UTILS_LOG_MIN_LEVEL 1
+#endif
+    constexpr Level MinLevel = static_cast<Level>(UTILS_LOG_MIN_LEVEL);
+
+    constexpr std::string_view name(Level level)
+    {
+        constexpr std::string_view names[] = {"TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "OFF"};
+        return names[to_underlying(level)];
+    }
+
+    constexpr Definition::Color color(Level level)
+    {
+        constexpr Definition::Color colors[] =
+        {
+            Definition::Color::White, Definition::Color::Cyan, Definition::Color::Green,
+            Definition::Color::Yellow, Definition::Color::Red, Definition::Color::White
+        };
+        return colors[to_underlying(level)];
+    }
+
+    // format string checked against the argument count when constructed
+    template <typename... Args>
+    class Format
+    {
+    public:
+        template <size_t N>
+        consteval Format(const char (&text)[N]) : m_text(text, N - 1)
+        {
+            size_t placeholders = 0;
+            for (size_t i = 0; i < m_text.size(); ++i)
+            {
+                if (m_text[i] == '{')
+                {
+                    if (i + 1 < m_text.size() && m_text[i + 1] == '{') { ++i; continue; }
+                    if (i + 1 < m_text.size() && m_text[i + 1] == '}') { ++i; ++placeholders; continue; }
+                    throw "unmatched '{' in log format";
+                }
+                if (m_text[i] == '}')
+                {
+                    if (i + 1 < m_text.size() && m_text[i + 1] == '}') { ++i; continue; }
+                    throw "unmatched '}' in log format";
+                }
+            }
+            if (placeholders != sizeof...(Args))
+            {
+                throw "log format placeholders do not match the argument count";
+            }
+        }
+
+        constexpr std::string_view text() const { return m_text; }
+
+    private:
+        std::string_view m_text;
+    };
+
+    // One per log statement, constant-initialized so that checking it needs no
+    // guard: registered on its first execution, then only its state is read.
+    struct Callsite
+    {
+        enum : uint8_t { Unregistered, Disabled, Enabled };
+
+        constexpr Callsite(Level level_, const char* file_, int line_)
+            : level(level_), file(file_), line(line_)
+        {
+        }
+
+        std::atomic<uint8_t> state{Unregistered};
+        Level level;
+        const char* file;
+        int line;
+        Callsite* next{nullptr};
+    };
+
+    class Registry
+    {
+    public:
+        static Registry& instance()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        bool registerCallsite(Callsite& callsite)
+        {
+            std::lock_guard lock(m_mutex);
+            if (callsite.state.load(std::memory_order_relaxed) == Callsite::Unregistered)
+            {
+                callsite.next = m_head;
+                m_head = &callsite;
+                apply(callsite);
+            }
+            return callsite.state.load(std::memory_order_relaxed) == Callsite::Enabled;
+        }
+
+        void setRuntimeLevel(Level level)
+        {
+            std::lock_guard lock(m_mutex);
+            m_runtimeLevel = level;
+            m_overrides.clear();
+            for (auto* callsite = m_head; callsite; callsite = callsite->next)
+            {
+                apply(*callsite);
+            }
+        }
+
+        // file matches on its suffix, line 0 for every line; returns the registered
+        // callsites changed, the ones registered later follow it as well
+        size_t setEnabled(std::string_view file, int line, bool enabled)
+        {
+            std::lock_guard lock(m_mutex);
+            m_overrides.push_back({std::string(file), line, enabled});
+            size_t changed = 0;
+            for (auto* callsite = m_head; callsite; callsite = callsite->next)
+            {
+                if (m_overrides.back().matches(*callsite))
+                {
+                    apply(*callsite);
+                    ++changed;
+                }
+            }
+            return changed;
+        }
+
+    private:
+        struct Override
+        {
+            std::string file;
+            int line;
+            bool enabled;
+
+            bool matches(const Callsite& callsite) const
+            {
+                return std::string_view(callsite.file).ends_with(file) && (line == 0 || line == callsite.line);
+            }
+        };
+
+        // under the lock: runtime level, then the overrides in the order given
+        void apply(Callsite& callsite) const
+        {
+            auto enabled = callsite.level >= m_runtimeLevel;
+            for (const auto& override : m_overrides)
+            {
+                if (override.matches(callsite)) enabled = override.enabled;
+            }
+            callsite.state.store(enabled ? Callsite::Enabled : Callsite::Disabled, std::memory_order_relaxed);
+        }
+
+        std::mutex m_mutex;
+        Callsite* m_head{nullptr};
+        Level m_runtimeLevel{MinLevel};
+        std::vector<Override> m_overrides;
+    };
+
+    // callsites below level are disabled, earlier setEnabled() calls are forgotten
+    inline void setRuntimeLevel(Level level) { Registry::instance().setRuntimeLevel(level); }
+
+    // toggles the registered callsites of a file (suffix match), or one line of it
+    inline size_t setEnabled(std::string_view file, int line, bool enabled)
+    {
+        return Registry::instance().setEnabled(file, line, enabled);
+    }
+
+    inline bool enabled(Callsite& callsite)
+    {
+        auto state = callsite.state.load(std::memory_order_relaxed);
+        if (state == Callsite::Unregistered) [[unlikely]]
+        {
+            return Registry::instance().registerCallsite(callsite);
+        }
+        return state == Callsite::Enabled;
+    }
+
+    namespace Detail
+    {
+        // literal text up to the next placeholder, braces unescaped; returns the rest
+        inline std::string_view appendLiteral(std::string& out, std::string_view format)
+        {
+            size_t i = 0;
+            for (; i < format.size(); ++i)
+            {
+                if (format[i] == '{' && format[i + 1] == '}') return format.substr(i + 2);
+                out.push_back(format[i]);
+                if (format[i] == '{' || format[i] == '}') ++i;    // "{{" or "}}"
+            }
+            return {};
+        }
+
+        template <typename... Args>
+        std::string_view render(std::string_view format, const Args&... args)
+        {
+            thread_local std::string buffer;
+            buffer.clear();
+            ((format = appendLiteral(buffer, format), StringCreator::append(buffer, args)), ...);
+            appendLiteral(buffer, format);
+            return buffer;
+        }
+    }
+
+    template <typename... Args>
+    void write(Level level, Format<std::type_identity_t<Args>...> format, const Args&... args)
+    {
+        auto text = Detail::render(format.text(), args...);
+#ifdef UTILS_ASYNC_LOG
+        AsyncLog::print(color(level), "[", name(level), "] ", text);
+#else
+        print(color(level), "[", name(level), "] ", text);
+#endif
+    }
+}
+
+#define UTILS_LOG(level, format, ...)                                                           \
+    do                                                                                          \
+    {                                                                                           \
+        if constexpr ((level) >= Utils::Log::MinLevel)                                          \
+        {                                                                                       \
+            constinit static Utils::Log::Callsite utils_log_callsite{(level), __FILE__, __LINE__}; \
+            if (Utils::Log::enabled(utils_log_callsite))                                        \
+            {                                                                                   \
+                Utils::Log::write((level), format __VA_OPT__(,) __VA_ARGS__);                   \
+            }                                                                                   \
+        }                                                                                       \
+    } while (false)
+
+#define LOG_TRACE(format, ...)      UTILS_LOG(Utils::Log::Level::Trace,     format __VA_OPT__(,) __VA_ARGS__)
+#define LOG_DEBUG(format, ...)      UTILS_LOG(Utils::Log::Level::Debug,     format __VA_OPT__(,) __VA_ARGS__)
+#define LOG_INFO(format, ...)       UTILS_LOG(Utils::Log::Level::Info,      format __VA_OPT__(,) __VA_ARGS__)
+#define LOG_WARNING(format, ...)    UTILS_LOG(Utils::Log::Level::Warning,   format __VA_OPT__(,) __VA_ARGS__)
+#define LOG_ERROR(format, ...)      UTILS_LOG(Utils::Log::Level::Error,     format __VA_OPT__(,) __VA_ARGS__)
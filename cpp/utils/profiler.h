@@ -0,0 +1,312 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "utils.h"
+
+// Scoped instrumentation for hot paths, where time_elapsed is too heavy:
+//     void step()
+//     {
+//         PROFILE_ZONE("step");
+//         ...
+//         { PROFILE_ZONE("step/inner"); ... }
+//     }
+// A zone reads the time stamp counter (steady_clock off x86) when entered and
+// left, and appends one event to a buffer of its thread: no lock, no allocation
+// but a new chunk every ChunkEvents events. Zones nest; each event keeps its
+// depth. Afterwards, Utils::Profile::stats() aggregates per zone and
+// writeChromeTrace() exports every event for chrome://tracing or Perfetto.
+//
+// Events of a thread stay available after it exits. Reading while zones are
+// recorded sees the events completed so far.
+namespace Utils::Profile
+{
+    constexpr size_t ChunkEvents = 4096;
+    constexpr size_t MaxChunks = 4096;     // per thread, further events are dropped
+
+    // one per PROFILE_ZONE, constant-initialized
+    struct Site
+    {
+        const char* name;
+        const char* file;
+        int line;
+    };
+
+    struct Event
+    {
+        const Site* site;
+        uint64_t begin;     // ticks
+        uint64_t end;
+        uint32_t depth;     // 0 for an outermost zone
+    };
+
+    inline uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    namespace Detail
+    {
+        // events of one thread, appended by it only
+        class ThreadBuffer
+        {
+        public:
+            explicit ThreadBuffer(uint32_t id) : id(id) {}
+
+            ~ThreadBuffer()
+            {
+                for (auto& chunk : m_chunks) delete[] chunk.load(std::memory_order_relaxed);
+            }
+
+            void push(const Event& event)
+            {
+                auto n = m_count.load(std::memory_order_relaxed);
+                auto* chunk = n % ChunkEvents == 0 ? grow(n) : m_current;
+                if (!chunk) [[unlikely]]
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                chunk[n % ChunkEvents] = event;
+                m_count.store(n + 1, std::memory_order_release);
+            }
+
+            // calls f on every event completed so far
+            template <typename F>
+            void forEach(F&& f) const
+            {
+                auto count = m_count.load(std::memory_order_acquire);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    f(m_chunks[i / ChunkEvents].load(std::memory_order_relaxed)[i % ChunkEvents]);
+                }
+            }
+
+            const uint32_t id;
+            uint32_t depth = 0;
+            std::atomic<size_t> dropped{0};
+
+        private:
+            Event* grow(size_t n)
+            {
+                auto index = n / ChunkEvents;
+                if (index >= MaxChunks) return nullptr;
+                m_current = new Event[ChunkEvents];
+                m_chunks[index].store(m_current, std::memory_order_relaxed);
+                return m_current;
+            }
+
+            std::atomic<size_t> m_count{0};
+            Event* m_current = nullptr;
+            std::array<std::atomic<Event*>, MaxChunks> m_chunks{};
+        };
+
+        class Registry
+        {
+        public:
+            static Registry& instance()
+            {
+                static Registry registry;
+                return registry;
+            }
+
+            ThreadBuffer& add()
+            {
+                std::lock_guard lock(m_mutex);
+                m_buffers.push_back(std::make_shared<ThreadBuffer>(static_cast<uint32_t>(m_buffers.size())));
+                return *m_buffers.back();
+            }
+
+            std::vector<std::shared_ptr<const ThreadBuffer>> buffers() const
+            {
+                std::lock_guard lock(m_mutex);
+                return {m_buffers.begin(), m_buffers.end()};
+            }
+
+            // ticks to nanoseconds, measured between the first zone and now
+            double nanosecondsPerTick() const
+            {
+                auto ticksNow = ticks();
+                auto clockNow = std::chrono::steady_clock::now();
+                auto ns = std::chrono::duration<double, std::nano>(clockNow - m_clockStart).count();
+                return ticksNow > m_ticksStart ? ns / static_cast<double>(ticksNow - m_ticksStart) : 1.0;
+            }
+
+            uint64_t ticksStart() const { return m_ticksStart; }
+
+        private:
+            Registry() : m_ticksStart(ticks()), m_clockStart(std::chrono::steady_clock::now())
+            {
+            }
+
+            mutable std::mutex m_mutex;
+            std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+            uint64_t m_ticksStart;
+            std::chrono::steady_clock::time_point m_clockStart;
+        };
+
+        // constant-initialized: no TLS init wrapper on the hot path
+        inline thread_local ThreadBuffer* t_buffer = nullptr;
+
+        inline ThreadBuffer& threadBuffer()
+        {
+            if (!t_buffer) [[unlikely]] t_buffer = &Registry::instance().add();
+            return *t_buffer;
+        }
+    }
+
+    class Zone
+    {
+    public:
+        explicit Zone(const Site& site) : m_buffer(Detail::threadBuffer()), m_site(&site), m_depth(m_buffer.depth++), m_begin(ticks())
+        {
+        }
+
+        ~Zone()
+        {
+            auto end = ticks();
+            m_buffer.depth = m_depth;
+            m_buffer.push({m_site, m_begin, end, m_depth});
+        }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        Detail::ThreadBuffer& m_buffer;
+        const Site* m_site;
+        uint32_t m_depth;
+        uint64_t m_begin;
+    };
+
+    struct ZoneStats
+    {
+        std::string name;
+        size_t count = 0;
+        double total = 0;   // ns
+        double min = 0;
+        double max = 0;
+        double p50 = 0;
+        double p90 = 0;
+        double p99 = 0;
+    };
+
+    // per zone name, sorted by total time
+    inline std::vector<ZoneStats> stats()
+    {
+        auto& registry = Detail::Registry::instance();
+        auto scale = registry.nanosecondsPerTick();
+
+        std::map<std::string_view, std::vector<uint64_t>> durations;
+        for (const auto& buffer : registry.buffers())
+        {
+            buffer->forEach([&](const Event& e) { durations[e.site->name].push_back(e.end - e.begin); });
+        }
+
+        std::vector<ZoneStats> result;
+        for (auto& [name, ticks] : durations)
+        {
+            std::sort(ticks.begin(), ticks.end());
+            auto at = [&](double q) { return static_cast<double>(ticks[static_cast<size_t>(q * static_cast<double>(ticks.size() - 1))]) * scale; };
+            ZoneStats s;
+            s.name = name;
+            s.count = ticks.size();
+            s.total = static_cast<double>(std::accumulate(ticks.begin(), ticks.end(), uint64_t{0})) * scale;
+            s.min = at(0);
+            s.max = at(1);
+            s.p50 = at(0.5);
+            s.p90 = at(0.9);
+            s.p99 = at(0.99);
+            result.push_back(std::move(s));
+        }
+        std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.total > b.total; });
+        return result;
+    }
+
+    // one line per zone, times in microseconds
+    inline void report(std::ostream& os = std::cout)
+    {
+        std::string line;
+        for (const auto& s : stats())
+        {
+            line.clear();
+            StringCreator::append(line, s.name, ": count ", s.count, " total ", s.total / 1e3, " min ", s.min / 1e3,
+                                  " p50 ", s.p50 / 1e3, " p90 ", s.p90 / 1e3, " p99 ", s.p99 / 1e3, " max ", s.max / 1e3, "[µs]\n");
+            os << line;
+        }
+    }
+
+    // Chrome trace event format: one complete ("X") event per zone, microseconds
+    // since the first zone of the process, one tid per recording thread.
+    // Throws std::runtime_error when path cannot be written.
+    inline void writeChromeTrace(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file) throw std::runtime_error("cannot write " + path);
+
+        auto& registry = Detail::Registry::instance();
+        auto scale = registry.nanosecondsPerTick();
+        auto start = registry.ticksStart();
+
+        // fixed point, to the nanosecond: %g would round long traces
+        auto microseconds = [&](std::string& out, uint64_t ticks)
+        {
+            auto ns = static_cast<uint64_t>(static_cast<double>(ticks) * scale);
+            char fraction[4] = {static_cast<char>('0' + ns / 100 % 10), static_cast<char>('0' + ns / 10 % 10),
+                                static_cast<char>('0' + ns % 10), '\0'};
+            StringCreator::append(out, ns / 1000, '.', fraction);
+        };
+
+        auto escaped = [](std::string& out, std::string_view text)
+        {
+            for (auto c : text)
+            {
+                if (c == '"' || c == '\\') out.push_back('\\');
+                out.push_back(c);
+            }
+        };
+
+        std::string out = "{\"traceEvents\":[\n";
+        bool first = true;
+        for (const auto& buffer : registry.buffers())
+        {
+            buffer->forEach([&](const Event& e)
+            {
+                out += first ? "" : ",\n";
+                first = false;
+                out += "{\"name\":\"";
+                escaped(out, e.site->name);
+                out += "\",\"ph\":\"X\",\"ts\":";
+                microseconds(out, e.begin - start);
+                out += ",\"dur\":";
+                microseconds(out, e.end - e.begin);
+                StringCreator::append(out, ",\"pid\":1,\"tid\":", buffer->id, ",\"args\":{\"depth\":", e.depth, ",\"line\":", e.site->line, "}}");
+            });
+            if (out.size() > (1 << 20))
+            {
+                file << out;
+                out.clear();
+            }
+        }
+        out += "\n]}\n";
+        file << out;
+        if (!file) throw std::runtime_error("cannot write " + path);
+    }
+}
+
+#define UTILS_PROFILE_CONCAT_(a, b)  a##b
+#define UTILS_PROFILE_CONCAT(a, b)   UTILS_PROFILE_CONCAT_(a, b)
+
+// times the rest of the enclosing scope as zone name (a string literal)
+#define PROFILE_ZONE(name)                                                                                      \
+    constinit static const Utils::Profile::Site UTILS_PROFILE_CONCAT(utils_profile_site_, __LINE__){name, __FILE__, __LINE__}; \
+    const Utils::Profile::Zone UTILS_PROFILE_CONCAT(utils_profile_zone_, __LINE__){UTILS_PROFILE_CONCAT(utils_profile_site_, __LINE__)}
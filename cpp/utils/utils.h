@@ -1,6 +1,10 @@
+#pragma once
+
 #include <algorithm>
 #include <atomic>
 #include <array>
+#include <charconv>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <exception>
@@ -14,6 +18,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <shared_mutex>
 #include <thread>
 #include <type_traits>
@@ -44,7 +49,120 @@ namespace Utils
             return s.m_stream.str();
         }
 
+        // same text as to_string, appended to a caller-supplied buffer without any
+        // stream: numbers go through std::to_chars, containers are walked in place.
+        // Returns the appended part, valid until the buffer is modified.
+        template<typename ... Args>
+        static std::string_view append(std::string& buffer, const Args&... args)
+        {
+            auto start = buffer.size();
+            BufferWriter writer{buffer};
+            (writer.write(args), ...);
+            return std::string_view(buffer).substr(start);
+        }
+
+        // same as append into a thread-local buffer reused by every call of the
+        // thread: no allocation once it has grown to the longest text.
+        // The view is valid until the next format() on the same thread.
+        template<typename ... Args>
+        static std::string_view format(const Args&... args)
+        {
+            thread_local std::string buffer;
+            buffer.clear();
+            return append(buffer, args...);
+        }
+
     private:
+        // formats like operator<< of a default std::ostream: floating point as
+        // %g with precision 6, bool as 0/1, char as a character
+        struct BufferWriter
+        {
+            std::string& out;
+
+            template <typename T>
+            void write(const T& obj)
+            {
+                if constexpr (std::is_same_v<T, char>)
+                {
+                    out.push_back(obj);
+                }
+                else if constexpr (std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char> || std::is_same_v<T, bool>)
+                {
+                    write(+obj);
+                }
+                else if constexpr (std::is_integral_v<T>)
+                {
+                    char digits[24];
+                    out.append(digits, std::to_chars(digits, digits + sizeof(digits), obj).ptr);
+                }
+                else if constexpr (std::is_floating_point_v<T>)
+                {
+                    char digits[64];
+                    out.append(digits, std::to_chars(digits, digits + sizeof(digits), obj, std::chars_format::general, 6).ptr);
+                }
+                else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+                {
+                    out.append(std::string_view(obj));
+                }
+                else
+                {
+                    // anything else only knows operator<<
+                    thread_local std::ostringstream stream;
+                    stream.str({});
+                    stream << obj;
+                    out.append(stream.view());
+                }
+            }
+
+            template <typename T>
+            void write(const std::vector<T>& vector)
+            {
+                writeCollection(vector);
+            }
+
+            template <typename T>
+            void write(const std::set<T>& set)
+            {
+                writeCollection(set);
+            }
+
+            template <typename T, size_t N>
+            void write(const std::array<T, N>& array)
+            {
+                writeCollection(array);
+            }
+
+            template <typename Key, typename Value>
+            void write(const std::map<Key, Value>& map)
+            {
+                writeCollection(map);
+            }
+
+            template <typename Key, typename Value>
+            void write(const std::pair<Key, Value>& pair)
+            {
+                out.push_back('{');
+                write(pair.first);
+                out.push_back(',');
+                write(pair.second);
+                out.push_back('}');
+            }
+
+            template <typename Collection>
+            void writeCollection(const Collection& collection)
+            {
+                out.push_back('{');
+                bool first = true;
+                for (const auto& value : collection)
+                {
+                    if (!first) out.push_back(',');
+                    write(value);
+                    first = false;
+                }
+                out.push_back('}');
+            }
+        };
+
         StringCreator() = default;
     
         template <typename T, typename ... Args>
@@ -128,19 +246,21 @@ namespace Utils
     };
 
     template<typename ... Args>
-    void printAuto(Args... args)
+    void printAuto(const Args&... args)
     {
-        std::cout << StringCreator::to_string(args...);        // text concat-ed
+        std::cout << StringCreator::format(args...);            // text concat-ed
     }
 
     // print text with color
     // default end = '\n'
+    // the whole line is formatted in the thread's buffer and written at once
     template<typename ... Args>
-    void print(Definition::Color color, Args... args)
+    void print(Definition::Color color, const Args&... args)
     {
-        std::cout   << "\033[" << to_underlying(color) << "m"   // start color
-                    << StringCreator::to_string(args...)        // text concat-ed
-                    << Definition::ColorReset << '\n';          // end color with '\n'
+        auto line = StringCreator::format("\033[", to_underlying(color), "m",   // start color
+                                          args...,                              // text concat-ed
+                                          Definition::ColorReset, '\n');       // end color with '\n'
+        std::cout.write(line.data(), line.size());
     }
 
     // NOTE: do not mark static for this function, otherwise we hit data race
@@ -157,14 +277,32 @@ namespace Utils
     }
 }
 
-#define BLACK(...)      Utils::print(Definition::Color::Black,      __VA_ARGS__ )
-#define RED(...)        Utils::print(Definition::Color::Red,        __VA_ARGS__ )
-#define GREEN(...)      Utils::print(Definition::Color::Green,      __VA_ARGS__ )
-#define YELLOW(...)     Utils::print(Definition::Color::Yellow,     __VA_ARGS__ )
-#define BLUE(...)       Utils::print(Definition::Color::Blue,       __VA_ARGS__ )
-#define MAGENTA(...)    Utils::print(Definition::Color::Magenta,    __VA_ARGS__ )
-#define CYAN(...)       Utils::print(Definition::Color::Cyan,       __VA_ARGS__ )
-#define WHITE(...)      Utils::print(Definition::Color::White,      __VA_ARGS__ )
+// -DUTILS_ASYNC_LOG: the color macros hand their arguments to a background thread
+// -DUTILS_BINARY_LOG: the color macros store raw arguments in a ring file, see binaryLog.h
+#if defined(UTILS_ASYNC_LOG) && defined(UTILS_BINARY_LOG)
+#error "UTILS_ASYNC_LOG and UTILS_BINARY_LOG are exclusive"
+#elif defined(UTILS_ASYNC_LOG)
+#include "asyncLogger.h"
+#define UTILS_PRINT(...)    Utils::AsyncLog::print(__VA_ARGS__)
+#elif defined(UTILS_BINARY_LOG)
+#include "binaryLog.h"
+#define UTILS_PRINT(color, ...)                                                                 \
+    Utils::BinaryLog::Detail::log<decltype([] {                                                 \
+        return Utils::BinaryLog::Descriptor{__FILE__, __LINE__, Utils::to_underlying(color), nullptr}; \
+    })>(__VA_ARGS__)
+#else
+#define UTILS_PRINT(...)    Utils::print(__VA_ARGS__)
+#endif
+
+// always printed; the leveled, filterable LOG_* macros are in log.h
+#define BLACK(...)      UTILS_PRINT(Definition::Color::Black,      __VA_ARGS__ )
+#define RED(...)        UTILS_PRINT(Definition::Color::Red,        __VA_ARGS__ )
+#define GREEN(...)      UTILS_PRINT(Definition::Color::Green,      __VA_ARGS__ )
+#define YELLOW(...)     UTILS_PRINT(Definition::Color::Yellow,     __VA_ARGS__ )
+#define BLUE(...)       UTILS_PRINT(Definition::Color::Blue,       __VA_ARGS__ )
+#define MAGENTA(...)    UTILS_PRINT(Definition::Color::Magenta,    __VA_ARGS__ )
+#define CYAN(...)       UTILS_PRINT(Definition::Color::Cyan,       __VA_ARGS__ )
+#define WHITE(...)      UTILS_PRINT(Definition::Color::White,      __VA_ARGS__ )
 
 // TODO:
 // std::flat_map